@@ -0,0 +1,474 @@
+// Benchmarks for nghs_ht and nghs_graph, separate from the unit tests.
+// Every option takes a comma separated list and every combination runs:
+//   ./bench --n 10000000 --B 16,32,64 --batch 1000,1000000 --format csv
+// Each run goes through the phases insert, build (the same edges loaded
+// into a fresh structure with rebuild_from), find, update, fetch, mix and
+// delete and writes one row per phase with its throughput, the latency
+// percentiles of its batches and the bytes per entry of the structure.
+#include "nghs_graph.h"
+#include "nghs_ht.h"
+#include "parlay/parallel.h"
+#include "parlay/primitives.h"
+#include "parlay/sequence.h"
+#include "parlay/utilities.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <tuple>
+#include <vector>
+
+struct config {
+  size_t n = 1000000;        // entries, edges for the graph workloads
+  uint32_t B = 16;           // 16, 32 or 64
+  std::string probe;         // linear, robin_hood or swiss
+  size_t batch = 100000;     // ops per batch
+  double load = 0.5;         // initial fill of a single table
+  double tombstones = 0;     // share of entries deleted before find
+  std::string levels;        // uniform, geometric or connectivity
+  std::string workload;      // single, small or hubs
+};
+
+struct row {
+  config c;
+  std::string phase;
+  size_t ops = 0;
+  double seconds = 0;
+  std::vector<double> batch_us; // one per batch
+  double bytes_per_entry = 0;
+};
+
+using clock_type = std::chrono::steady_clock;
+template <class F> double time_us(F &&f) {
+  auto start = clock_type::now();
+  f();
+  return std::chrono::duration<double, std::micro>(clock_type::now() - start)
+      .count();
+}
+
+// level of edge e: uniform over 2..32, geometric from level 2 up, or
+// geometric from level 32 down, the shape level-based connectivity leaves
+// behind as edges are pushed to lower levels. Level 1 holds one edge per
+// vertex, make_edges hands it out
+uint32_t level_of(const std::string &levels, uint64_t e) {
+  uint64_t h = parlay::hash64(e * 0x9e3779b97f4a7c15ull + 1);
+  if (levels == "geometric")
+    return 2 + std::min(30, __builtin_ctzll(h | ((uint64_t)1 << 30)));
+  if (levels == "connectivity")
+    return 32 - std::min(30, __builtin_ctzll(h | ((uint64_t)1 << 30)));
+  return h % 31 + 2;
+}
+
+// (vertex, neighbor, level) edges of a workload. single: one table,
+// small: n / 8 vertices of degree 8, hubs: 1% of n / 8 vertices hold 90%
+// of the edges. Neighbors j * c ^ u are distinct per vertex for j < 2^31
+using edge = std::tuple<uint32_t, uint32_t, uint32_t>;
+uint32_t num_vertices(const config &c) {
+  return c.workload == "single" ? 1 : std::max<size_t>(1, c.n / 8);
+}
+parlay::sequence<edge> make_edges(const config &c) {
+  uint32_t V = num_vertices(c);
+  uint32_t H = std::max<uint32_t>(1, V / 100);
+  size_t to_hubs = c.workload == "hubs" ? c.n / 10 * 9 : c.n;
+  auto edges = parlay::tabulate(c.n, [&](size_t e) {
+    uint32_t u, j;
+    if (c.workload != "hubs") {
+      u = e % V;
+      j = e / V;
+    } else if (e < to_hubs) {
+      u = e % H;
+      j = e / H;
+    } else {
+      u = H + (e - to_hubs) % std::max<uint32_t>(1, V - H);
+      j = (e - to_hubs) / std::max<uint32_t>(1, V - H);
+    }
+    uint32_t v = ((uint32_t)(j * 2654435761u) ^ u) & 0x7fffffff;
+    // under connectivity every other vertex keeps its first edge at level 1
+    if (c.levels == "connectivity" && j == 0 && u % 2 == 0)
+      return edge(u, v, 1);
+    return edge(u, v, level_of(c.levels, e));
+  });
+  return parlay::random_shuffle(edges);
+}
+
+// one interface over a single table and a graph, every call is one batch
+template <uint32_t B, class Probe> struct single_store {
+  using table_t = nghs_ht<B, Probe>;
+  table_t A;
+  explicit single_store(const config &c)
+      : A((uint32_t)std::min<double>(c.n / c.load, UINT32_MAX - B)) {}
+  template <class S> void insert(const S &es) {
+    auto ins = parlay::delayed_seq<std::pair<uint32_t, uint32_t>>(
+        es.size(), [&](size_t i) {
+          return std::pair(std::get<1>(es[i]), std::get<2>(es[i]));
+        });
+    A.batch_insertion(ins);
+  }
+  template <class S> void build(const config &, const S &es) {
+    auto ins = parlay::delayed_seq<std::pair<uint32_t, uint32_t>>(
+        es.size(), [&](size_t i) {
+          return std::pair(std::get<1>(es[i]), std::get<2>(es[i]));
+        });
+    table_t T(ins);
+  }
+  template <class S> void update(const S &es) {
+    auto upd = parlay::delayed_seq<std::pair<uint32_t, uint32_t>>(
+        es.size(), [&](size_t i) {
+          return std::pair(std::get<1>(es[i]), std::get<2>(es[i]));
+        });
+    A.batch_update(upd);
+  }
+  template <class S> void remove(const S &es) {
+    auto del = parlay::delayed_seq<uint32_t>(
+        es.size(), [&](size_t i) { return std::get<1>(es[i]); });
+    A.batch_deletion(del);
+  }
+  template <class S> size_t find(const S &es) {
+    auto keys = parlay::delayed_seq<uint32_t>(
+        es.size(), [&](size_t i) { return std::get<1>(es[i]); });
+    auto found = A.batch_find(keys);
+    return parlay::count_if(found, [](uint32_t l) { return l != 0; });
+  }
+  size_t fetch(size_t round, size_t k) {
+    return A.fetch(k, round % 31 + 2).size();
+  }
+  template <class S> void apply(const S &ops) {
+    auto o = parlay::delayed_seq<std::tuple<uint32_t, uint32_t, nghs_op>>(
+        ops.size(), [&](size_t i) {
+          auto &[u, v, l, op] = ops[i];
+          return std::tuple(v, l, op);
+        });
+    A.batch_apply(o);
+  }
+  size_t space() { return A.get_space_usage(); }
+  size_t size() { return A.get_size(); }
+};
+template <uint32_t B, class Probe> struct graph_store {
+  using graph_t = nghs_graph<B, Probe>;
+  graph_t G;
+  explicit graph_store(const config &c) : G(num_vertices(c)) {}
+  template <class S> void insert(const S &es) {
+    auto s = parlay::to_sequence(es);
+    G.batch_insertion(s);
+  }
+  template <class S> void build(const config &c, const S &es) {
+    graph_t H(num_vertices(c));
+    auto s = parlay::to_sequence(es);
+    H.rebuild_from(s);
+  }
+  template <class S> void update(const S &es) {
+    auto s = parlay::to_sequence(es);
+    G.batch_update(s);
+  }
+  template <class S> void remove(const S &es) {
+    auto s = parlay::map(es, [](const edge &e) {
+      return std::pair(std::get<0>(e), std::get<1>(e));
+    });
+    G.batch_deletion(s);
+  }
+  // the graph has no batch_find, group the batch by vertex as it would
+  template <class S> size_t find(const S &es) {
+    size_t n = es.size();
+    auto sorted = parlay::integer_sort(
+        parlay::to_sequence(es), [](const edge &e) { return std::get<0>(e); });
+    auto starts = parlay::pack_index<size_t>(
+        parlay::delayed_seq<bool>(n, [&](size_t i) {
+          return i == 0 ||
+                 std::get<0>(sorted[i]) != std::get<0>(sorted[i - 1]);
+        }));
+    auto found = parlay::tabulate(starts.size(), [&](size_t g) {
+      size_t s = starts[g];
+      size_t e = (g + 1 == starts.size()) ? n : starts[g + 1];
+      auto keys = parlay::delayed_seq<uint32_t>(
+          e - s, [&](size_t i) { return std::get<1>(sorted[s + i]); });
+      auto res = G[std::get<0>(sorted[s])].batch_find(keys);
+      return parlay::count_if(res, [](uint32_t l) { return l != 0; });
+    });
+    return parlay::reduce(found);
+  }
+  // k level l neighbors of up to k vertices
+  size_t fetch(size_t round, size_t k) {
+    size_t V = G.num_vertices(), m = std::min(V, k);
+    auto got = parlay::tabulate(m, [&](size_t i) {
+      return G[(round * m + i) % V].fetch(8, round % 31 + 2).size();
+    });
+    return parlay::reduce(got);
+  }
+  template <class S> void apply(const S &ops) {
+    auto s = parlay::to_sequence(ops);
+    G.batch_apply(s);
+  }
+  size_t space() { return G.get_space_usage(); }
+  size_t size() {
+    auto sizes = parlay::tabulate(G.num_vertices(), [&](size_t u) {
+      return (size_t)G[u].get_size();
+    });
+    return parlay::reduce(sizes);
+  }
+};
+
+template <class Store>
+void run_phases(const config &c, std::vector<row> &rows) {
+  Store S(c);
+  auto edges = make_edges(c);
+  size_t n = edges.size(), batch = std::max<size_t>(1, c.batch);
+  auto slice = [&](auto &seq, size_t s) {
+    size_t e = std::min(seq.size(), s + batch);
+    return parlay::delayed_seq<std::decay_t<decltype(seq[0])>>(
+        e - s, [&seq, s](size_t i) { return seq[s + i]; });
+  };
+  auto phase = [&](const std::string &name, size_t rounds, auto &&f) {
+    row r;
+    r.c = c;
+    r.phase = name;
+    for (size_t i = 0; i < rounds; i++) {
+      size_t ops = 0;
+      r.batch_us.push_back(time_us([&] { ops = f(i); }));
+      r.ops += ops;
+    }
+    for (auto us : r.batch_us)
+      r.seconds += us / 1e6;
+    size_t entries = S.size();
+    r.bytes_per_entry = entries ? (double)S.space() / entries : 0;
+    rows.push_back(std::move(r));
+  };
+  size_t rounds = (n + batch - 1) / batch;
+
+  phase("insert", rounds, [&](size_t i) {
+    auto s = slice(edges, i * batch);
+    S.insert(s);
+    return s.size();
+  });
+  phase("build", 1, [&](size_t) {
+    S.build(c, edges);
+    return n;
+  });
+  // tombstones: drop a share of the entries before the lookups, the
+  // table compacts by itself once they pass a quarter of its slots
+  size_t dropped = (size_t)(c.tombstones * n);
+  for (size_t s = 0; s < dropped; s += batch) {
+    auto del = parlay::delayed_seq<edge>(
+        std::min(batch, dropped - s), [&](size_t i) { return edges[s + i]; });
+    S.remove(del);
+  }
+  auto live = parlay::to_sequence(parlay::delayed_seq<edge>(
+      n - dropped, [&](size_t i) { return edges[dropped + i]; }));
+  size_t live_rounds = (live.size() + batch - 1) / batch;
+  phase("find", live_rounds, [&](size_t i) {
+    auto s = slice(live, i * batch);
+    if (S.find(s) != s.size()) {
+      std::cerr << "find missed an entry" << std::endl;
+      std::abort();
+    }
+    return s.size();
+  });
+  auto moved = parlay::map(live, [&](const edge &e) {
+    return edge(std::get<0>(e), std::get<1>(e),
+                std::get<2>(e) % 31 + 2);
+  });
+  phase("update", live_rounds, [&](size_t i) {
+    auto s = slice(moved, i * batch);
+    S.update(s);
+    return s.size();
+  });
+  phase("fetch", live_rounds, [&](size_t i) { return S.fetch(i, batch); });
+  // interleaved rounds: a mixed batch over the live neighbors and as many
+  // new ones, then a fetch
+  using op = std::tuple<uint32_t, uint32_t, uint32_t, nghs_op>;
+  phase("mix", live_rounds, [&](size_t i) {
+    auto ops = parlay::tabulate(std::min(batch, live.size()), [&](size_t j) {
+      uint64_t h = parlay::hash64(i * batch + j);
+      auto [u, v, l] = live[h % live.size()];
+      if (h >> 32 & 1) // a neighbor the vertex does not have yet
+        v = ~v & 0x7fffffff;
+      return op(u, v, level_of(c.levels, h), (nghs_op)(h >> 40 & 3));
+    });
+    S.apply(ops);
+    return ops.size() + S.fetch(i, batch);
+  });
+  // whatever mix left behind goes out with the original neighbors
+  auto extra = parlay::map(live, [](const edge &e) {
+    auto [u, v, l] = e;
+    return edge(u, ~v & 0x7fffffff, l);
+  });
+  phase("delete", live_rounds, [&](size_t i) {
+    auto s = slice(live, i * batch);
+    auto x = slice(extra, i * batch);
+    auto both = parlay::to_sequence(s);
+    both.append(parlay::to_sequence(x));
+    // a mixed batch leaves out the neighbors that are not there
+    auto present = parlay::tabulate(both.size(), [&](size_t j) {
+      return std::tuple(std::get<0>(both[j]), std::get<1>(both[j]),
+                        (uint32_t)0, nghs_op::remove);
+    });
+    S.apply(present);
+    return s.size() + x.size();
+  });
+}
+
+template <uint32_t B, class Probe>
+void run_probe(const config &c, std::vector<row> &rows) {
+  if (c.workload == "single")
+    run_phases<single_store<B, Probe>>(c, rows);
+  else
+    run_phases<graph_store<B, Probe>>(c, rows);
+}
+template <uint32_t B> void run_B(const config &c, std::vector<row> &rows) {
+  if (c.probe == "robin_hood")
+    run_probe<B, robin_hood_probing>(c, rows);
+  else if (c.probe == "swiss")
+    run_probe<B, swiss_probing>(c, rows);
+  else
+    run_probe<B, linear_probing>(c, rows);
+}
+void run(const config &c, std::vector<row> &rows) {
+  if (c.B == 64)
+    run_B<64>(c, rows);
+  else if (c.B == 32)
+    run_B<32>(c, rows);
+  else
+    run_B<16>(c, rows);
+}
+
+double percentile(std::vector<double> v, double p) {
+  if (v.empty())
+    return 0;
+  std::sort(v.begin(), v.end());
+  return v[std::min(v.size() - 1, (size_t)(p * v.size()))];
+}
+const char *fields =
+    "workload,B,probe,n,batch,threads,load,tombstones,levels,phase,ops,"
+    "seconds,mops,batch_p50_us,batch_p90_us,batch_p99_us,batch_max_us,"
+    "bytes_per_entry";
+void write_rows(std::ostream &out, const std::vector<row> &rows,
+                bool json) {
+  if (json)
+    out << "[\n";
+  else
+    out << fields << "\n";
+  for (size_t i = 0; i < rows.size(); i++) {
+    auto &r = rows[i];
+    double mops = r.seconds > 0 ? r.ops / r.seconds / 1e6 : 0;
+    std::vector<std::pair<std::string, std::string>> kv = {
+        {"workload", r.c.workload},
+        {"B", std::to_string(r.c.B)},
+        {"probe", r.c.probe},
+        {"n", std::to_string(r.c.n)},
+        {"batch", std::to_string(r.c.batch)},
+        {"threads", std::to_string(parlay::num_workers())},
+        {"load", std::to_string(r.c.load)},
+        {"tombstones", std::to_string(r.c.tombstones)},
+        {"levels", r.c.levels},
+        {"phase", r.phase},
+        {"ops", std::to_string(r.ops)},
+        {"seconds", std::to_string(r.seconds)},
+        {"mops", std::to_string(mops)},
+        {"batch_p50_us", std::to_string(percentile(r.batch_us, 0.5))},
+        {"batch_p90_us", std::to_string(percentile(r.batch_us, 0.9))},
+        {"batch_p99_us", std::to_string(percentile(r.batch_us, 0.99))},
+        {"batch_max_us", std::to_string(percentile(r.batch_us, 1))},
+        {"bytes_per_entry", std::to_string(r.bytes_per_entry)}};
+    for (size_t j = 0; j < kv.size(); j++) {
+      bool text = kv[j].first == "workload" || kv[j].first == "probe" ||
+                  kv[j].first == "levels" || kv[j].first == "phase";
+      if (json)
+        out << (j ? ", " : "  {") << "\"" << kv[j].first << "\": "
+            << (text ? "\"" + kv[j].second + "\"" : kv[j].second);
+      else
+        out << (j ? "," : "") << kv[j].second;
+    }
+    out << (json ? (i + 1 < rows.size() ? "},\n" : "}\n") : "\n");
+  }
+  if (json)
+    out << "]\n";
+}
+
+std::vector<std::string> split(const std::string &s) {
+  std::vector<std::string> parts;
+  std::stringstream in(s);
+  for (std::string p; std::getline(in, p, ',');)
+    parts.push_back(p);
+  return parts;
+}
+
+int main(int argc, char **argv) {
+  // defaults, each may be a list
+  std::vector<std::pair<std::string, std::string>> opts = {
+      {"n", "1000000"},        {"B", "16,32,64"},
+      {"probe", "linear"},     {"batch", "1000,100000"},
+      {"load", "0.5"},         {"tombstones", "0"},
+      {"levels", "uniform"},   {"workload", "single,small,hubs"},
+      {"threads", "0"},        {"format", "csv"},
+      {"out", "-"}};
+  auto usage = [&](std::ostream &out) {
+    out << "options:";
+    for (auto &o : opts)
+      out << " --" << o.first << " " << o.second;
+    out << std::endl;
+  };
+  for (int i = 1; i < argc; i += 2) {
+    std::string key = argv[i];
+    if (key == "--help" || key == "-h") {
+      usage(std::cout);
+      return 0;
+    }
+    auto it = std::find_if(opts.begin(), opts.end(), [&](auto &o) {
+      return "--" + o.first == key;
+    });
+    if (it == opts.end() || i + 1 == argc) {
+      std::cerr << (it == opts.end() ? "unknown option " : "no value for ")
+                << key << ", ";
+      usage(std::cerr);
+      return 1;
+    }
+    it->second = argv[i + 1];
+  }
+  auto get = [&](const std::string &k) {
+    return std::find_if(opts.begin(), opts.end(),
+                        [&](auto &o) { return o.first == k; })
+        ->second;
+  };
+  // the scheduler reads the worker count when it starts, so one process
+  // runs with one thread count
+  if (get("threads") != "0")
+    setenv("PARLAY_NUM_THREADS", get("threads").c_str(), 1);
+  std::vector<config> configs(1);
+  auto expand = [&](const std::string &k, auto &&set) {
+    std::vector<config> next;
+    for (auto &c : configs)
+      for (auto &v : split(get(k))) {
+        config d = c;
+        set(d, v);
+        next.push_back(d);
+      }
+    configs = next;
+  };
+  expand("workload", [](config &c, auto &v) { c.workload = v; });
+  expand("levels", [](config &c, auto &v) { c.levels = v; });
+  expand("n", [](config &c, auto &v) { c.n = std::stoull(v); });
+  expand("B", [](config &c, auto &v) { c.B = std::stoul(v); });
+  expand("probe", [](config &c, auto &v) { c.probe = v; });
+  expand("batch", [](config &c, auto &v) { c.batch = std::stoull(v); });
+  expand("load", [](config &c, auto &v) { c.load = std::stod(v); });
+  expand("tombstones",
+         [](config &c, auto &v) { c.tombstones = std::stod(v); });
+  std::vector<row> rows;
+  for (auto &c : configs) {
+    std::cerr << c.workload << " B = " << c.B << " " << c.probe
+              << " n = " << c.n << " batch = " << c.batch << std::endl;
+    run(c, rows);
+  }
+  bool json = get("format") == "json";
+  if (get("out") == "-")
+    write_rows(std::cout, rows, json);
+  else {
+    std::ofstream out(get("out"));
+    write_rows(out, rows, json);
+  }
+  return 0;
+}
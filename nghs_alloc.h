@@ -0,0 +1,159 @@
+#ifndef NEIGHBOR_HASH_ALLOC
+#define NEIGHBOR_HASH_ALLOC
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#if defined(__linux__)
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+// Allocation policies for the blocks of a table that has no arena, the
+// arena takes its slabs from huge_pages<>. Every policy hands out memory
+// aligned to at least 64 bytes, so no B-block straddles more cache lines
+// than it has to. deallocate() must be passed the bytes allocate() was.
+namespace nghs_alloc {
+
+constexpr size_t huge_page = (size_t)1 << 21;
+
+inline size_t round_up(size_t bytes, size_t to) {
+  return (bytes + to - 1) / to * to;
+}
+inline void out_of_memory() {
+  std::cerr << "out of memory" << std::endl;
+  std::abort();
+}
+
+// whole huge pages on a 2MB boundary. Explicit asks for pages reserved
+// through vm.nr_hugepages first, otherwise, or when there are none left,
+// the mapping is madvised for transparent huge pages
+inline char *map_huge(size_t bytes, bool explicit_pages) {
+  size_t len = round_up(bytes, huge_page);
+#if defined(__linux__)
+#if defined(MAP_HUGETLB)
+  if (explicit_pages) {
+    void *p = mmap(nullptr, len, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    if (p != MAP_FAILED)
+      return (char *)p;
+  }
+#endif
+  // over-map by one huge page and trim both ends to the boundary
+  void *m = mmap(nullptr, len + huge_page, PROT_READ | PROT_WRITE,
+                 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (m == MAP_FAILED)
+    out_of_memory();
+  char *p = (char *)round_up((uintptr_t)m, huge_page);
+  if (p > (char *)m)
+    munmap(m, p - (char *)m);
+  if (p + len < (char *)m + len + huge_page)
+    munmap(p + len, (char *)m + len + huge_page - (p + len));
+#if defined(MADV_HUGEPAGE)
+  madvise(p, len, MADV_HUGEPAGE);
+#endif
+  return p;
+#else
+  (void)explicit_pages;
+  char *p = (char *)aligned_alloc(huge_page, len);
+  if (p == nullptr)
+    out_of_memory();
+  return p;
+#endif
+}
+inline void unmap_huge(char *p, size_t bytes) {
+#if defined(__linux__)
+  munmap(p, round_up(bytes, huge_page));
+#else
+  (void)bytes;
+  free(p);
+#endif
+}
+
+// online NUMA nodes as an mbind mask, empty on a single node machine
+struct node_mask {
+  static constexpr size_t max_nodes = 1024;
+  unsigned long bits[max_nodes / (8 * sizeof(unsigned long))] = {};
+  size_t nodes = 0;
+  node_mask() {
+    // a list of ranges like "0-3,8-11"
+    FILE *f = fopen("/sys/devices/system/node/online", "r");
+    if (f == nullptr)
+      return;
+    unsigned lo, hi;
+    while (fscanf(f, "%u", &lo) == 1) {
+      hi = lo;
+      int c = fgetc(f);
+      if (c == '-') {
+        if (fscanf(f, "%u", &hi) != 1)
+          break;
+        c = fgetc(f);
+      }
+      for (unsigned n = lo; n <= hi && n < max_nodes; n++, nodes++)
+        bits[n / (8 * sizeof(unsigned long))] |=
+            1UL << (n % (8 * sizeof(unsigned long)));
+      if (c != ',')
+        break;
+    }
+    fclose(f);
+  }
+};
+// spread the pages of [p, p + len) round robin over the nodes, before
+// anything touches them. Best effort, a failed mbind leaves the default
+inline void interleave(char *p, size_t len) {
+#if defined(__linux__) && defined(SYS_mbind)
+  static const node_mask mask;
+  if (mask.nodes < 2)
+    return;
+  constexpr int mpol_interleave = 3;
+  syscall(SYS_mbind, p, len, mpol_interleave, mask.bits,
+          node_mask::max_nodes + 1, 0);
+#else
+  (void)p;
+  (void)len;
+#endif
+}
+
+} // namespace nghs_alloc
+
+// aligned_alloc on cache line boundaries
+struct cache_aligned {
+  static char *allocate(size_t bytes) {
+    char *p = (char *)aligned_alloc(64, nghs_alloc::round_up(bytes, 64));
+    if (p == nullptr)
+      nghs_alloc::out_of_memory();
+    return p;
+  }
+  static void deallocate(char *p, size_t) { free(p); }
+};
+// blocks of a huge page or more are mapped in whole 2MB pages, fewer TLB
+// misses on large tables. Explicit takes reserved hugetlbfs pages while
+// there are any, transparent huge pages otherwise. Smaller blocks stay
+// cache_aligned
+template <bool Explicit = false> struct huge_pages {
+  static char *allocate(size_t bytes) {
+    if (bytes < nghs_alloc::huge_page)
+      return cache_aligned::allocate(bytes);
+    return nghs_alloc::map_huge(bytes, Explicit);
+  }
+  static void deallocate(char *p, size_t bytes) {
+    if (bytes < nghs_alloc::huge_page)
+      cache_aligned::deallocate(p, bytes);
+    else
+      nghs_alloc::unmap_huge(p, bytes);
+  }
+};
+// huge_pages whose pages are interleaved over the NUMA nodes, so a table
+// every socket reads is not served by one memory controller
+template <bool Explicit = false>
+struct numa_interleaved : huge_pages<Explicit> {
+  static char *allocate(size_t bytes) {
+    char *p = huge_pages<Explicit>::allocate(bytes);
+    size_t len = nghs_alloc::round_up(bytes, nghs_alloc::huge_page);
+    if (bytes >= nghs_alloc::huge_page)
+      nghs_alloc::interleave(p, len);
+    return p;
+  }
+};
+#endif
@@ -0,0 +1,148 @@
+#ifndef NEIGHBOR_HASH_ARENA
+#define NEIGHBOR_HASH_ARENA
+#include "nghs_alloc.h"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <mutex>
+#include <sys/mman.h>
+#include <utility>
+#include <vector>
+// Slab allocator shared by the neighbor tables of one graph.
+// Blocks are rounded up to size classes (64-byte units, four classes per
+// power of two) and recycled through per-class free lists, so a table that
+// grows hands its old block to the next table of that size. Slabs are
+// whole transparent huge pages, see huge_pages in nghs_alloc.h. A snapshot
+// mapping can be handed over too, its blocks are never recycled.
+class nghs_arena {
+private:
+  static constexpr size_t unit = 64;
+  static constexpr size_t chunk_size = (size_t)1 << 21;
+  static constexpr size_t num_classes = 256;
+  using slab_alloc = huge_pages<>;
+
+  struct free_list {
+    std::mutex m;
+    std::vector<char *> blocks;
+  };
+
+  free_list lists[num_classes];
+  std::mutex chunks_m;
+  std::vector<std::pair<char *, size_t>> chunks; // slabs owned, and bytes
+  std::atomic<size_t> reserved;
+  std::vector<std::pair<char *, size_t>> mappings; // adopted, and bytes
+  std::atomic<bool> mapped{false};
+
+  bool in_mapping(char *p) {
+    std::lock_guard<std::mutex> g(chunks_m);
+    for (auto [m, bytes] : mappings)
+      if (p >= m && p < m + bytes)
+        return true;
+    return false;
+  }
+
+  static size_t class_index(size_t bytes) {
+    size_t units = (bytes + unit - 1) / unit;
+    if (units <= 4)
+      return units;
+    size_t e = 63 - __builtin_clzll(units);
+    size_t step = (size_t)1 << (e - 2);
+    return 4 * (e - 1) + (units - ((size_t)1 << e) + step - 1) / step;
+  }
+  static size_t class_bytes(size_t c) {
+    if (c <= 4)
+      return c * unit;
+    size_t e = c / 4 + 1;
+    return (((size_t)1 << e) + (c % 4) * ((size_t)1 << (e - 2))) * unit;
+  }
+
+  char *new_chunk(size_t bytes) {
+    char *p = slab_alloc::allocate(bytes);
+    reserved += bytes;
+    std::lock_guard<std::mutex> g(chunks_m);
+    chunks.emplace_back(p, bytes);
+    return p;
+  }
+
+public:
+  nghs_arena() : reserved(0) {}
+  ~nghs_arena() {
+    for (auto [p, bytes] : chunks)
+      slab_alloc::deallocate(p, bytes);
+    for (auto [p, bytes] : mappings)
+      munmap(p, bytes);
+  }
+  nghs_arena(const nghs_arena &) = delete;
+  nghs_arena &operator=(const nghs_arena &) = delete;
+
+  // bytes actually handed out for a request of this size
+  static size_t block_size(size_t bytes) {
+    return class_bytes(class_index(bytes));
+  }
+
+  char *allocate(size_t bytes) {
+    size_t c = class_index(bytes);
+    size_t cb = class_bytes(c);
+    if (cb >= chunk_size) { // large blocks map their own huge pages
+      reserved += cb;
+      return slab_alloc::allocate(cb);
+    }
+    {
+      std::lock_guard<std::mutex> g(lists[c].m);
+      if (!lists[c].blocks.empty()) {
+        char *p = lists[c].blocks.back();
+        lists[c].blocks.pop_back();
+        return p;
+      }
+    }
+    // carve a fresh slab, keep the first block and shelve the rest
+    size_t k = chunk_size / cb;
+    char *p = new_chunk(k * cb);
+    std::lock_guard<std::mutex> g(lists[c].m);
+    for (size_t i = k - 1; i > 0; i--)
+      lists[c].blocks.push_back(p + i * cb);
+    return p;
+  }
+
+  void deallocate(char *p, size_t bytes) {
+    if (p == nullptr || (mapped && in_mapping(p)))
+      return;
+    size_t c = class_index(bytes);
+    size_t cb = class_bytes(c);
+    if (cb >= chunk_size) {
+      reserved -= cb;
+      slab_alloc::deallocate(p, cb);
+      return;
+    }
+    std::lock_guard<std::mutex> g(lists[c].m);
+    lists[c].blocks.push_back(p);
+  }
+
+  // one slab holding count blocks of block_size(bytes) each,
+  // every block can later be returned to deallocate() on its own
+  char *allocate_bulk(size_t count, size_t bytes) {
+    if (count == 0)
+      return nullptr;
+    size_t c = class_index(bytes);
+    size_t cb = class_bytes(c);
+    if (cb >= chunk_size) {
+      std::cerr << "bulk blocks must be smaller than an arena chunk"
+                << std::endl;
+      std::abort();
+    }
+    return new_chunk(count * cb);
+  }
+
+  // take over a mapping, it is unmapped with the arena
+  void adopt_mapping(char *p, size_t bytes) {
+    reserved += bytes;
+    std::lock_guard<std::mutex> g(chunks_m);
+    mappings.emplace_back(p, bytes);
+    mapped = true;
+  }
+
+  size_t get_space_usage() const { return sizeof(nghs_arena) + reserved; }
+};
+#endif
@@ -0,0 +1,156 @@
+#ifndef NEIGHBOR_HASH_EPOCH
+#define NEIGHBOR_HASH_EPOCH
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <functional>
+#include <iostream>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+// Epoch based reclamation for blocks that readers may still hold.
+// A reader enters by writing the current epoch to its thread's slot and
+// leaves by clearing it. A writer that unlinks a block retires it at the
+// current epoch and bumps the epoch, the block is freed once every reader
+// inside entered after that.
+class nghs_epoch {
+private:
+  static constexpr size_t max_threads = 1024;
+  struct alignas(64) slot {
+    std::atomic<uint64_t> epoch{0}; // 0: outside
+    std::atomic<bool> owned{false}; // held by a live thread
+  };
+
+  slot slots[max_threads];
+  std::atomic<uint64_t> current{1};
+  std::atomic<size_t> used_slots{0}; // no slot past this was ever owned
+  std::mutex m;
+  std::vector<std::pair<uint64_t, std::function<void()>>> retired;
+
+  // slot of the calling thread and how deep it is nested, the slot goes
+  // back to the domain when the thread exits
+  struct thread_state {
+    nghs_epoch *domain = nullptr;
+    size_t slot = max_threads;
+    size_t depth = 0;
+    ~thread_state() {
+      if (domain)
+        domain->slots[slot].owned.store(false, std::memory_order_release);
+    }
+  };
+  thread_state &local() {
+    static thread_local thread_state s;
+    if (s.slot == max_threads) {
+      s.slot = acquire_slot();
+      s.domain = this;
+    }
+    return s;
+  }
+  // first slot no live thread owns
+  size_t acquire_slot() {
+    for (size_t i = 0; i < max_threads; i++) {
+      bool expected = false;
+      if (!slots[i].owned.load(std::memory_order_relaxed) &&
+          slots[i].owned.compare_exchange_strong(expected, true)) {
+        size_t n = used_slots.load();
+        while (n <= i && !used_slots.compare_exchange_weak(n, i + 1))
+          ;
+        return i;
+      }
+    }
+    std::cerr << "too many reader threads" << std::endl;
+    std::abort();
+  }
+  // oldest epoch a reader is in, everything retired before it is safe
+  uint64_t oldest() {
+    uint64_t o = UINT64_MAX;
+    size_t n = used_slots.load();
+    for (size_t i = 0; i < n; i++) {
+      uint64_t e = slots[i].epoch.load();
+      if (e != 0 && e < o)
+        o = e;
+    }
+    return o;
+  }
+
+public:
+  nghs_epoch() = default;
+  nghs_epoch(const nghs_epoch &) = delete;
+  nghs_epoch &operator=(const nghs_epoch &) = delete;
+  ~nghs_epoch() { synchronize(); }
+
+  // the domain every concurrent table shares
+  static nghs_epoch &global() {
+    static nghs_epoch e;
+    return e;
+  }
+
+  void enter() {
+    auto &s = local();
+    if (s.depth++ == 0) // seq_cst: the slot is visible before any load
+      slots[s.slot].epoch.store(current.load());
+  }
+  void leave() {
+    auto &s = local();
+    if (--s.depth == 0)
+      slots[s.slot].epoch.store(0, std::memory_order_release);
+  }
+  // keeps the blocks a reader loaded alive while it is in scope
+  class guard {
+    nghs_epoch *e;
+
+  public:
+    explicit guard(bool active) : e(active ? &global() : nullptr) {
+      if (e)
+        e->enter();
+    }
+    ~guard() {
+      if (e)
+        e->leave();
+    }
+    guard(const guard &) = delete;
+    guard &operator=(const guard &) = delete;
+  };
+
+  // run free once no reader can hold what the caller just unlinked
+  void retire(std::function<void()> free) {
+    {
+      std::lock_guard<std::mutex> g(m);
+      retired.emplace_back(current.fetch_add(1), std::move(free));
+    }
+    collect();
+  }
+  // free whatever no reader can reach any more
+  void collect() {
+    std::vector<std::function<void()>> ready;
+    {
+      std::lock_guard<std::mutex> g(m);
+      uint64_t o = oldest();
+      size_t kept = 0;
+      for (auto &r : retired) {
+        if (r.first < o)
+          ready.push_back(std::move(r.second));
+        else
+          retired[kept++] = std::move(r);
+      }
+      retired.resize(kept);
+    }
+    for (auto &f : ready)
+      f();
+  }
+  // wait until every retired block is freed, readers must be leaving
+  void synchronize() {
+    while (true) {
+      collect();
+      {
+        std::lock_guard<std::mutex> g(m);
+        if (retired.empty())
+          return;
+      }
+      std::this_thread::yield();
+    }
+  }
+};
+#endif
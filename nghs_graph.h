@@ -0,0 +1,180 @@
+#ifndef NEIGHBOR_HASH_GRAPH
+#define NEIGHBOR_HASH_GRAPH
+#include "nghs_arena.h"
+#include "nghs_ht.h"
+#include "parlay/parallel.h"
+#include "parlay/primitives.h"
+#include "parlay/sequence.h"
+#include <cstdint>
+#include <tuple>
+#include <utility>
+// One nghs_ht per vertex, all tables draw their blocks from a shared arena.
+// Tables start in small mode unless a larger capacity is asked for, then the
+// initial blocks of every vertex come out of a single slab. A table that
+// grows moves to a bigger block and returns the old one to the arena.
+// Policies are passed on to nghs_ht, e.g. nghs_graph<16, robin_hood_probing>
+// or nghs_graph<16, linear_probing, wide_tree>.
+template <uint32_t B = 16, class... Policies> class nghs_graph {
+public:
+  using table_t = nghs_ht<B, Policies...>;
+  using key_t = uint32_t;                   // vertex id
+  using ngh_t = typename table_t::key_type; // neighbor key
+  using val_t = typename table_t::level_type;
+
+private:
+  nghs_arena arena; // declared first so it outlives the tables
+  parlay::sequence<table_t> tables;
+
+  // sort a cross-vertex batch by its first component (the vertex) and run
+  // f(u, sorted, start, end) on every group in parallel, a table only goes
+  // parallel inside when its group is large
+  template <class T, class F> void for_each_group(T &batch, F &&f) {
+    size_t n = batch.size();
+    if (n == 0)
+      return;
+    auto sorted = parlay::integer_sort(
+        batch, [](const auto &e) { return (key_t)std::get<0>(e); });
+    auto starts = parlay::pack_index<size_t>(
+        parlay::delayed_seq<bool>(n, [&](size_t i) {
+          return i == 0 ||
+                 std::get<0>(sorted[i]) != std::get<0>(sorted[i - 1]);
+        }));
+    parlay::parallel_for(
+        0, starts.size(),
+        [&](size_t g) {
+          size_t s = starts[g];
+          size_t e = (g + 1 == starts.size()) ? n : starts[g + 1];
+          f((key_t)std::get<0>(sorted[s]), sorted, s, e);
+        },
+        1);
+  }
+
+public:
+  // n vertices, each table sized for capacity neighbors
+  nghs_graph(key_t n, key_t capacity = 0) {
+    if (table_t::small_mode &&
+        capacity <= table_t::small_capacity) { // inline, no blocks yet
+      tables = parlay::tabulate(
+          n, [&](size_t) { return table_t(capacity, &arena); });
+      return;
+    }
+    auto cap = table_t::initial_capacity(capacity);
+    auto bytes = table_t::block_bytes(cap);
+    auto stride = nghs_arena::block_size(bytes);
+    char *slab = arena.allocate_bulk(n, bytes);
+    tables = parlay::tabulate(n, [&](size_t i) {
+      return table_t(cap, slab + i * stride, &arena);
+    });
+  }
+  // blocks retired under concurrent readers go back to the arena first
+  ~nghs_graph() {
+    if constexpr (table_t::concurrent)
+      nghs_epoch::global().synchronize();
+  }
+  // a graph saved by save(), every block is used where the mapping put it
+  nghs_graph(const char *path, nghs_snapshot::mode m) {
+    auto mp = nghs_snapshot::map(path, m, table_t::snapshot_layout(),
+                                 table_t::small_capacity, table_t::block_bytes);
+    arena.adopt_mapping(mp.base, mp.bytes);
+    auto records = mp.records();
+    tables = parlay::tabulate(mp.get_header().tables, [&](size_t i) {
+      return table_t(records[i], mp.base, &arena);
+    });
+  }
+  nghs_graph(const nghs_graph &) = delete;
+  nghs_graph &operator=(const nghs_graph &) = delete;
+
+  key_t num_vertices() const { return tables.size(); }
+  table_t &operator[](key_t u) { return tables[u]; }
+  const table_t &operator[](key_t u) const { return tables[u]; }
+
+  // batch insertion: sequence of (vertex, neighbor, level)
+  template <class T = parlay::sequence<std::tuple<key_t, ngh_t, val_t>>>
+  void batch_insertion(T &ins) {
+    for_each_group(ins, [&](key_t u, auto &sorted, size_t s, size_t e) {
+      auto group = parlay::delayed_seq<std::pair<ngh_t, val_t>>(
+          e - s, [&](size_t i) {
+            return std::pair((ngh_t)std::get<1>(sorted[s + i]),
+                             (val_t)std::get<2>(sorted[s + i]));
+          });
+      tables[u].batch_insertion(group);
+    });
+  }
+  // load an edge list of (vertex, neighbor, level): the table of every
+  // vertex in it is rebuilt with exactly its edges in one pass, see
+  // nghs_ht::rebuild_from. Other vertices keep theirs
+  template <class T = parlay::sequence<std::tuple<key_t, ngh_t, val_t>>>
+  void rebuild_from(T &edges) {
+    for_each_group(edges, [&](key_t u, auto &sorted, size_t s, size_t e) {
+      auto group = parlay::delayed_seq<std::pair<ngh_t, val_t>>(
+          e - s, [&](size_t i) {
+            return std::pair((ngh_t)std::get<1>(sorted[s + i]),
+                             (val_t)std::get<2>(sorted[s + i]));
+          });
+      tables[u].rebuild_from(group);
+    });
+  }
+  // repair every table that lazy_repair batches left marked, see
+  // nghs_ht::flush. Queries do it per table otherwise
+  void flush() {
+    parlay::parallel_for(0, tables.size(),
+                         [&](size_t u) { tables[u].flush(); });
+  }
+  // batch update: sequence of (vertex, neighbor, level)
+  template <class T = parlay::sequence<std::tuple<key_t, ngh_t, val_t>>>
+  void batch_update(T &upd) {
+    for_each_group(upd, [&](key_t u, auto &sorted, size_t s, size_t e) {
+      auto group = parlay::delayed_seq<std::pair<ngh_t, val_t>>(
+          e - s, [&](size_t i) {
+            return std::pair((ngh_t)std::get<1>(sorted[s + i]),
+                             (val_t)std::get<2>(sorted[s + i]));
+          });
+      tables[u].batch_update(group);
+    });
+  }
+  // batch deletion: sequence of (vertex, neighbor)
+  template <class T = parlay::sequence<std::pair<key_t, ngh_t>>>
+  void batch_deletion(T &del) {
+    for_each_group(del, [&](key_t u, auto &sorted, size_t s, size_t e) {
+      auto group = parlay::delayed_seq<ngh_t>(
+          e - s, [&](size_t i) { return (ngh_t)std::get<1>(sorted[s + i]); });
+      tables[u].batch_deletion(group);
+    });
+  }
+
+  // mixed batch: sequence of (vertex, neighbor, level, op), see
+  // nghs_ht::batch_apply
+  template <class T = parlay::sequence<
+                std::tuple<key_t, ngh_t, val_t, nghs_op>>>
+  void batch_apply(T &ops) {
+    for_each_group(ops, [&](key_t u, auto &sorted, size_t s, size_t e) {
+      auto group = parlay::delayed_seq<std::tuple<ngh_t, val_t, nghs_op>>(
+          e - s, [&](size_t i) {
+            auto &[v, n, l, op] = sorted[s + i];
+            return std::tuple((ngh_t)n, (val_t)l, op);
+          });
+      tables[u].batch_apply(group);
+    });
+  }
+
+  // write every table to path, see nghs_snapshot.h
+  void save(const char *path) {
+    parlay::parallel_for(0, tables.size(),
+                         [&](size_t i) { tables[i].settle(); });
+    nghs_snapshot::save(
+        path, table_t::snapshot_layout(), tables.size(),
+        [&](uint64_t i) { return tables[i].snapshot_bytes(); },
+        [&](uint64_t i, uint64_t offset) {
+          return tables[i].snapshot_record(offset);
+        },
+        [&](uint64_t i) { return tables[i].records_navigation; });
+  }
+
+  // tables plus every slab the arena holds, including recycled blocks
+  size_t get_space_usage() {
+    // blocks and sample counts both come from the arena
+    return sizeof(nghs_graph) + sizeof(table_t) * tables.size() +
+           arena.get_space_usage() - sizeof(nghs_arena);
+  }
+};
+#endif
@@ -1,8 +1,15 @@
 #ifndef NEIGHBOR_HASH_RECORD
 #define NEIGHBOR_HASH_RECORD
+#include "nghs_alloc.h"
+#include "nghs_arena.h"
+#include "nghs_epoch.h"
+#include "nghs_simd.h"
+#include "nghs_snapshot.h"
+#include "nghs_stats.h"
 #include "parlay/parallel.h"
 #include "parlay/sequence.h"
 #include "parlay/utilities.h"
+#include <array>
 #include <atomic>
 #include <bitset>
 #include <cassert>
@@ -13,196 +20,1282 @@
 #include <limits>
 #include <parlay/primitives.h>
 #include <sys/types.h>
+#include <tuple>
+#include <type_traits>
 #include <utility>
+// probing policies
+// linear probing, deletions leave tombstones behind
+struct linear_probing {};
+// Robin Hood ordering, clusters stay sorted by home slot (ties by key) so
+// lookups stop early; deletion batches shift their clusters back instead of
+// leaving tombstones
+struct robin_hood_probing {};
+// linear probing with one control byte per slot (7 hash bits, or empty /
+// deleted) grouped per B-block, a probe tests a whole block with one SIMD
+// compare before reading any record
+struct swiss_probing {};
+// navigation tree policies
+// implicit tree with F children per node, children of node i sit at
+// F * i + 1 .. F * i + F. With 16 children a node's child masks fill one
+// cache line and are tested with a single SIMD compare
+template <uint32_t F> struct nary_tree {
+  static_assert(F >= 2 && F <= 16 && (F & (F - 1)) == 0,
+                "fanout must be a power of two up to 16");
+  static constexpr uint32_t fanout = F;
+};
+using binary_tree = nary_tree<2>;
+using wide_tree = nary_tree<16>;
+// entry layouts, a slot is swapped by a single CAS on word_type
+// 32-bit key next to a 32-bit level
+struct unpacked_entry {
+  using key_type = uint32_t;
+  using word_type = uint64_t;
+  //  reserved key, marks empty (level 0) and deleted (level 1) slots
+  static constexpr key_type reserved_key =
+      std::numeric_limits<key_type>::max();
+  static constexpr key_type max_key = reserved_key - 1;
+  static constexpr uint32_t max_level = 32;
+  key_type k;
+  uint32_t v;
+  constexpr unpacked_entry() : k(reserved_key), v(0) {}
+  constexpr unpacked_entry(key_type _k, uint32_t _v) : k(_k), v(_v) {}
+  static constexpr unpacked_entry make_empty() { return {reserved_key, 0}; }
+  static constexpr unpacked_entry make_deleted() { return {reserved_key, 1}; }
+  key_type key() const { return k; }
+  uint32_t level() const { return v; }
+  void set_level(uint32_t l) { v = l; }
+  bool operator==(const unpacked_entry &other) const {
+    return k == other.k && v == other.v;
+  }
+  bool operator!=(const unpacked_entry &other) const {
+    return !(*this == other);
+  }
+};
+// key and level - 1 packed into one Word, the level in the low LevelBits
+// bits: 27 + 5 bits in a uint32_t or 59 + 5 bits in a uint64_t. Levels go
+// up to 2^LevelBits, empty and deleted slots take the two largest keys
+template <class Word, uint32_t LevelBits = 5> struct packed_entry {
+  static_assert(std::is_same<Word, uint32_t>::value ||
+                    std::is_same<Word, uint64_t>::value,
+                "packed entries are 32 or 64 bits wide");
+  static_assert(LevelBits >= 1 && LevelBits <= 5,
+                "levels are at most 32, 5 bits hold them all");
+  using key_type = Word;
+  using word_type = Word;
+  static constexpr key_type reserved_key =
+      std::numeric_limits<Word>::max() >> LevelBits;
+  static constexpr key_type max_key = reserved_key - 2;
+  static constexpr uint32_t max_level = (uint32_t)1 << LevelBits;
+  static constexpr Word level_mask = ((Word)1 << LevelBits) - 1;
+  Word w;
+  constexpr packed_entry() : w(reserved_key << LevelBits) {}
+  constexpr packed_entry(key_type k, uint32_t l)
+      : w(k << LevelBits | (Word)(l - 1)) {}
+  // both read as level 1, like a tombstone, so masks and level tests skip
+  // them
+  static constexpr packed_entry make_empty() { return {reserved_key, 1}; }
+  static constexpr packed_entry make_deleted() {
+    return {reserved_key - 1, 1};
+  }
+  key_type key() const { return w >> LevelBits; }
+  uint32_t level() const { return (uint32_t)(w & level_mask) + 1; }
+  void set_level(uint32_t l) { w = (w & ~level_mask) | (Word)(l - 1); }
+  bool operator==(const packed_entry &other) const { return w == other.w; }
+  bool operator!=(const packed_entry &other) const { return w != other.w; }
+};
+
+// resize policies
+// a batch that needs room rehashes the whole table before it runs
+struct blocking_resize {
+  static constexpr bool incremental = false;
+  static constexpr uint32_t blocks_per_batch = 0;
+};
+// a batch that needs room only allocates the new table, every batch then
+// moves at least Blocks B-blocks of the old one over and lookups and fetch
+// read both until it is empty. Robin Hood tables keep resizing in one go,
+// their clusters cannot hold the tombstones a half moved table leaves
+template <uint32_t Blocks = 64> struct incremental_resize {
+  static constexpr bool incremental = true;
+  static constexpr uint32_t blocks_per_batch = Blocks;
+};
+
+// reader policies
+// queries must not overlap a batch
+struct exclusive_access {};
+// batch_find, fetch and count may run while one writer applies a batch.
+// batch_find sees every entry as it was before or after the batch, fetch
+// returns every entry the batch leaves alone while one the batch changes
+// may be missing until it ends; version() tells a reader whether a batch
+// ran in between. Blocks replaced under readers are freed through
+// nghs_epoch, small mode is off and Robin Hood probing is not supported
+struct concurrent_readers {};
+// what concurrent readers share with the writer, nothing otherwise
+template <bool Concurrent> struct nghs_readers {
+  void swap_readers(nghs_readers &) {}
+};
+template <> struct nghs_readers<true> {
+  std::atomic<char *> published{nullptr}; // the block queries read
+  std::atomic<uint64_t> batch_seq{0};     // odd while a batch runs
+  nghs_readers() = default;
+  nghs_readers(nghs_readers &&o) noexcept
+      : published(o.published.exchange(nullptr)),
+        batch_seq(o.batch_seq.load()) {}
+  void swap_readers(nghs_readers &o) {
+    published.store(o.published.exchange(published.load()));
+    batch_seq.store(o.batch_seq.exchange(batch_seq.load()));
+  }
+};
+
+// repair policies
+// every batch ends by repairing the navigation tree
+struct eager_repair {
+  static constexpr bool lazy = false;
+};
+// batches only mark the paths they touch in the dirty bits, the tree is
+// repaired once by the next query that reads it or by flush(). A node that
+// several batches in a row touch is rewritten once. Not with
+// concurrent_readers, a reader cannot repair
+struct lazy_repair {
+  static constexpr bool lazy = true;
+};
+
+// operations of a mixed batch, see nghs_ht::batch_apply
+enum class nghs_op : uint8_t {
+  insert, // set the level, same as upsert on a present key
+  update, // set the level of a present key, a missing key is left out
+  remove, // a missing key is left out
+  upsert, // set the level
+};
+
 // For the hash table, we generate a 32-bit bitmap for every B kv pairs
-template <uint32_t B = 16> class nghs_ht {
+template <uint32_t B = 16, class Probe = linear_probing,
+          class Tree = binary_tree, class Entry = unpacked_entry,
+          class Resize = blocking_resize, class Sync = exclusive_access,
+          class Alloc = cache_aligned, class Repair = eager_repair>
+class nghs_ht
+    : private nghs_readers<std::is_same<Sync, concurrent_readers>::value>,
+      private nghs_counters<nghs_stats_enabled> {
+public:
+  using key_type = typename Entry::key_type;
+  using level_type = uint32_t;
+
 private:
-  using key_t = uint32_t;
-  using val_t = uint32_t;
-  using index_t = key_t;
-  struct entry_t {
-    key_t k;
-    val_t v;
-    entry_t() : k(reserved_key), v(0) {}
-    constexpr entry_t(key_t _k, val_t _v) : k(_k), v(_v) {}
-    //  reserved entry
-    static constexpr key_t reserved_key = std::numeric_limits<key_t>::max();
-    static constexpr entry_t empty_entry{reserved_key, 0};
-    static constexpr entry_t deleted_entry{reserved_key, 1};
-    bool operator==(const entry_t &other) const {
-      return k == other.k && v == other.v;
-    }
-    bool operator!=(const entry_t &other) const { return !(*this == other); }
-  };
+  using key_t = key_type;
+  using val_t = level_type;
+  using index_t = uint32_t;
+  using entry_t = Entry;
+  static_assert(sizeof(entry_t) == sizeof(typename entry_t::word_type),
+                "an entry must fit the word a CAS swaps");
+  static constexpr entry_t empty_entry = entry_t::make_empty();
+  static constexpr entry_t deleted_entry = entry_t::make_deleted();
+  static constexpr bool packed = !std::is_same<Entry, unpacked_entry>::value;
 
   static constexpr double load_factor = 0.75;
   static constexpr double expand_factor = 2.0;
+  // shrink once fewer than 1/shrink_ratio of the slots are alive,
+  // compact in place once tombstones take 1/tombstone_ratio of the slots
+  static constexpr index_t shrink_ratio = 8;
+  static constexpr index_t tombstone_ratio = 4;
 
   static constexpr key_t reserved_key = entry_t::reserved_key;
+  static constexpr bool robin_hood =
+      std::is_same<Probe, robin_hood_probing>::value;
+  static constexpr bool swiss = std::is_same<Probe, swiss_probing>::value;
+  static_assert(!swiss || B <= 64, "swiss probing needs B <= 64");
+  static constexpr uint32_t Fanout = Tree::fanout;
+  static constexpr bool incremental = Resize::incremental && !robin_hood;
+  static constexpr bool concurrent =
+      std::is_same<Sync, concurrent_readers>::value;
+  static_assert(!concurrent || !robin_hood,
+                "Robin Hood moves entries under readers");
+  static constexpr bool lazy = Repair::lazy;
+  static_assert(!concurrent || !lazy, "readers cannot repair the tree");
+  // batches smaller than this run sequentially, which is the common case
+  // when a graph-wide batch is split into per-vertex groups
+  static constexpr size_t seq_threshold = 1024;
+  // batch ops prefetch the home slot of the op this far ahead
+  static constexpr size_t prefetch_distance = 16;
+
+  // Tables start in small mode: up to small_capacity entries kept unsorted
+  // inside the object, one cache line, no block and no tree. Crossing
+  // small_capacity moves them to a hash table, a deletion batch that leaves
+  // at most half of small_capacity moves them back
+  static constexpr index_t small_capacity = 64 / sizeof(entry_t);
+  // readers cannot follow entries in and out of the object
+  static constexpr bool small_mode = !concurrent;
 
   key_t roommate;   // level 1 edge
-  index_t capacity; // hash table capacity
+  index_t capacity; // hash table capacity, 0 in small mode
   index_t used_records;
-  char *records_navigation;
+  index_t deleted_records; // tombstones left by remove()
+  union {
+    char *records_navigation;
+    entry_t small_records[small_capacity]; // small mode, the first
+                                           // used_records are alive
+  };
+  // index_t *level_counts; // entries per level, level l at l - 1
   // entry_t *records; // hash table
   // uint32_t *navigation; // complete binary tree
+  // uint8_t *ctrl; // swiss probing only, one control byte per slot
+  nghs_arena *arena; // nullptr: records_navigation comes from Alloc
+  // per internal node and level, entries below it, level l at l - 1.
+  // Built by the first sample() and kept up to date by update_top_down
+  index_t *sample_counts;
 
-  entry_t *get_records() { return (entry_t *)records_navigation; }
+  // the per-level counters head the block, 128 bytes keep records aligned.
+  // Incremental resizing and concurrent readers add a cache line for the
+  // block state
+  static constexpr bool has_state = incremental || concurrent;
+  static constexpr size_t counts_bytes = sizeof(index_t) * 32;
+  static constexpr size_t header_bytes = counts_bytes + (has_state ? 64 : 0);
+  static index_t *counts_of(char *block) { return (index_t *)block; }
+  index_t *get_level_counts() { return counts_of(records_navigation); }
+  // the level counters and the roommate change under concurrent readers,
+  // in that mode the writer stores and the readers load them atomically
+  template <class T> static T shared_load(const T &x) {
+    if constexpr (concurrent)
+      return __atomic_load_n(&x, __ATOMIC_RELAXED);
+    else
+      return x;
+  }
+  template <class T> static void shared_store(T &x, T v) {
+    if constexpr (concurrent)
+      __atomic_store_n(&x, v, __ATOMIC_RELAXED);
+    else
+      x = v;
+  }
+  static index_t level_count(char *block, val_t l) {
+    return shared_load(counts_of(block)[l - 1]);
+  }
 
+  static entry_t *records_of(char *block) {
+    return (entry_t *)(block + header_bytes);
+  }
+  entry_t *get_records() { return records_of(records_navigation); }
+  struct block_state {
+    char *old_block; // table an incremental resize drains, or nullptr
+    index_t old_capacity;
+    index_t cursor;   // old blocks before this one are moved
+    index_t capacity; // of this block, for concurrent readers
+  };
+  static block_state *state_of(char *block) {
+    return (block_state *)(block + counts_bytes);
+  }
+  // migrate() clears it under readers once the old table is empty
+  static char *old_block_of(char *block) {
+    return __atomic_load_n(&state_of(block)->old_block, __ATOMIC_ACQUIRE);
+  }
+  block_state *get_state() { return state_of(records_navigation); }
+  // what a query reads: a block and its capacity, 0 in small mode
+  struct view {
+    char *block;
+    index_t cap;
+  };
+  view own_view() { return {records_navigation, capacity}; }
+  // concurrent readers take the published block, the writer only swaps it
+  // for a new one once that is complete
+  view reader_view() {
+    if constexpr (concurrent) {
+      char *b = this->published.load();
+      return {b, b ? state_of(b)->capacity : 0};
+    } else
+      return {records_navigation, capacity};
+  }
+  void publish() {
+    if constexpr (concurrent)
+      this->published.store(records_navigation);
+  }
+  // run query(t) on the published block until no newer block got published
+  // meanwhile: a resize moves the entries out of the block it replaces, a
+  // query still reading that block may miss them
+  template <class Q> auto read_current(Q &&query) {
+    while (true) {
+      view t = reader_view();
+      auto r = query(t);
+      if constexpr (concurrent) {
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (this->published.load() != t.block)
+          continue;
+      }
+      return r;
+    }
+  }
+  // brackets a writer op so version() is odd while it runs, and so the
+  // stats can tell batches apart
+  struct write_scope {
+    nghs_ht *t;
+    explicit write_scope(nghs_ht *_t) : t(_t) {
+      if constexpr (concurrent)
+        t->batch_seq++;
+      t->begin_batch();
+    }
+    ~write_scope() {
+      t->end_batch();
+      if constexpr (concurrent)
+        t->batch_seq++;
+    }
+  };
+  bool resizing() {
+    if constexpr (incremental)
+      return !is_small() && get_state()->old_block != nullptr;
+    else
+      return false;
+  }
+
+  // padding in front of the navigation tree so every group of siblings
+  // starts on a Fanout * 4 byte boundary, one cache line at fanout 16
+  static constexpr size_t navigation_pad =
+      Fanout > 2 ? sizeof(uint32_t) * (Fanout - 1) : 0;
+  static size_t navigation_offset(index_t cap) {
+    return header_bytes + sizeof(entry_t) * cap + navigation_pad;
+  }
+  static uint32_t *navigation_of(char *block, index_t cap) {
+    return (uint32_t *)(block + navigation_offset(cap));
+  }
   uint32_t *get_navigation() {
-    return (uint32_t *)(records_navigation + sizeof(entry_t) * capacity);
+    return navigation_of(records_navigation, capacity);
+  }
+  // one dirty bit per tree node, set by update_binary_tree and cleared by
+  // update_top_down, the masks themselves only ever hold level bits. The
+  // bits of a small tree fit the padding in front of it
+  static size_t dirty_words(index_t cap) {
+    return (navigation_length(cap / B) + 31) / 32;
+  }
+  static bool dirty_in_pad(index_t cap) {
+    return sizeof(uint32_t) * dirty_words(cap) <= navigation_pad;
+  }
+  static size_t dirty_offset(index_t cap) {
+    if (dirty_in_pad(cap))
+      return header_bytes + sizeof(entry_t) * cap;
+    return navigation_offset(cap) +
+           sizeof(uint32_t) * navigation_length(cap / B);
+  }
+  // end of the navigation tree and its dirty bits
+  static size_t tree_end(index_t cap) {
+    if (dirty_in_pad(cap))
+      return navigation_offset(cap) +
+             sizeof(uint32_t) * navigation_length(cap / B);
+    return dirty_offset(cap) + sizeof(uint32_t) * dirty_words(cap);
+  }
+  uint32_t *get_dirty() {
+    return (uint32_t *)(records_navigation + dirty_offset(capacity));
+  }
+  // control bytes start on the cache line after the dirty bits
+  static size_t ctrl_offset(index_t cap) {
+    return (tree_end(cap) + 63) / 64 * 64;
   }
+  static uint8_t *ctrl_of(char *block, index_t cap) {
+    return (uint8_t *)block + ctrl_offset(cap);
+  }
+  uint8_t *get_ctrl() { return ctrl_of(records_navigation, capacity); }
+  // control byte values, a live slot holds the top 7 bits of a second hash
+  static constexpr uint8_t ctrl_empty = 0x80;
+  static constexpr uint8_t ctrl_deleted = 0xfe;
+  static uint8_t ctrl_tag(key_t k) { return parlay::hash64(k) >> 57; }
   // iterate hash table
-  index_t firstIndex(key_t k) const { return parlay::hash32(k) % capacity; }
+  static uint64_t hash_key(key_t k) {
+    if constexpr (sizeof(key_t) == 8)
+      return parlay::hash64(k);
+    else
+      return parlay::hash32(k);
+  }
+  index_t firstIndex(key_t k) const { return hash_key(k) % capacity; }
   index_t incrementIndex(index_t h) {
     return ((h + 1) == capacity) ? 0 : h + 1;
   }
   index_t decrementIndex(index_t h) { return (h == 0) ? capacity - 1 : h - 1; }
+  // how far slot i is from home slot h along the probe sequence
+  index_t probe_distance(index_t h, index_t i) const {
+    return i >= h ? i - h : i + capacity - h;
+  }
+  // under Robin Hood a probe that is d slots from home can stop at the first
+  // entry sitting closer than d to its own home
+  bool probe_past(index_t i, index_t d) {
+    if constexpr (robin_hood) {
+      auto records = get_records();
+      return records[i] != deleted_entry &&
+             probe_distance(firstIndex(records[i].key()), i) < d;
+    } else
+      return false;
+  }
+
+  // level counters, records, the navigation tree and its dirty bits of a
+  // table with capacity cap
+  static size_t block_bytes(index_t cap) {
+    if constexpr (swiss)
+      return ctrl_offset(cap) + cap;
+    return tree_end(cap);
+  }
+  static index_t initial_capacity(index_t cap) {
+    return (std::max(cap, (index_t)B) / B + 1) * B;
+  }
+  char *allocate_block(index_t cap) {
+    if (arena)
+      return arena->allocate(block_bytes(cap));
+    return Alloc::allocate(block_bytes(cap));
+  }
+  static void release(nghs_arena *a, char *block, size_t bytes) {
+    if (a)
+      a->deallocate(block, bytes);
+    else
+      Alloc::deallocate(block, bytes);
+  }
+  void free_block(char *block, index_t cap) {
+    release(arena, block, block_bytes(cap));
+  }
+  // free a block the table no longer uses, once no reader holds it
+  void retire_block(char *block, index_t cap) {
+    if constexpr (concurrent) {
+      nghs_epoch::global().retire(
+          [a = arena, block, bytes = block_bytes(cap)]() {
+            release(a, block, bytes);
+          });
+    } else
+      free_block(block, cap);
+  }
+  // memset split over the workers, so each page is first touched, and on
+  // a NUMA machine placed, by the thread that fills it
+  static void parallel_fill(void *p, int c, size_t bytes) {
+    constexpr size_t page = 4096;
+    if (bytes < seq_threshold * page) {
+      memset(p, c, bytes);
+      return;
+    }
+    parlay::parallel_for(0, (bytes + page - 1) / page, [&](size_t i) {
+      memset((char *)p + i * page, c, std::min(page, bytes - i * page));
+    });
+  }
+  // empty records and a clean navigation tree
+  void init_block() {
+    memset(get_level_counts(), 0, header_bytes);
+    auto records = get_records();
+    parlay::parallel_for(0, capacity,
+                         [&](auto i) { records[i] = empty_entry; });
+    // std::cout << navigation_length << std::endl;
+    // navigation = new uint32_t[navigation_length];
+    auto navigation = get_navigation();
+    parallel_fill(navigation, 0,
+                  navigation_length(get_leaf_size()) * sizeof(uint32_t));
+    parallel_fill(get_dirty(), 0, dirty_words(capacity) * sizeof(uint32_t));
+    if constexpr (has_state)
+      get_state()->capacity = capacity;
+    if constexpr (swiss)
+      parallel_fill(get_ctrl(), ctrl_empty, capacity);
+  }
+
+  // move every live entry into a fresh block of new_capacity slots,
+  // tombstones are dropped on the way
+  void rehash(index_t new_capacity) {
+    if (resizing())
+      finish_resize();
+    // entry_t *old_records = records;
+    entry_t *old_records = get_records();
+    auto old_capacity = capacity;
+    auto old_records_navigation = records_navigation;
+    capacity = new_capacity;
+    records_navigation = allocate_block(capacity);
+    init_block();
+    memcpy(get_level_counts(), old_records_navigation, counts_bytes);
+    this->count_resize((uint64_t)used_records * sizeof(entry_t));
+    for_batch(old_capacity, [&](auto i) {
+      if (old_records[i] != empty_entry &&
+          old_records[i] != deleted_entry)
+        insert_slot(old_records[i].key(), old_records[i].level());
+    });
+    deleted_records = 0;
+    if (sample_counts) {
+      free_sample_counts(old_capacity);
+      sample_counts = alloc_sample_counts();
+    }
+    update_top_down(0, old_capacity >= seq_threshold);
+    publish();
+    // delete[] old_navigation;
+    // delete[] old_records;
+    retire_block(old_records_navigation, old_capacity);
+  }
 
   void ensure_capacity(uint32_t n_append) {
-    if (capacity * load_factor < n_append + used_records) {
-      // entry_t *old_records = records;
-      entry_t *old_records = get_records();
-      auto old_capacity = capacity;
-      // auto old_navigation = navigation;
-      auto old_navigation = get_navigation();
-      auto old_records_navigation = records_navigation;
-      capacity = (std::max(n_append + used_records,
-                           old_capacity * (index_t)expand_factor) /
-                      B +
-                  1) *
-                 B;
-      records_navigation = (char *)malloc(sizeof(entry_t) * capacity +
-                                          sizeof(uint32_t) * get_tree_size());
-      // records = new entry_t[capacity];
-      auto records = get_records();
-      parlay::parallel_for(0, capacity,
-                           [&](auto i) { records[i] = entry_t::empty_entry; });
-      auto navigation_length = get_tree_size();
-      // std::cout << navigation_length << std::endl;
-      // navigation = new uint32_t[navigation_length];
-      auto navigation = get_navigation();
-      memset(navigation, 0, navigation_length * sizeof(uint32_t));
-      parlay::parallel_for(0, old_capacity, [&](auto i) {
-        if (old_records[i] != entry_t::empty_entry ||
-            old_records[i] != entry_t::deleted_entry)
-          insert(old_records[i].k, old_records[i].v);
+    [[maybe_unused]] auto timed = this->time(nghs_phase::ensure_capacity);
+    // tombstones still sit on probe chains, count them as occupied
+    if (capacity * load_factor < n_append + used_records + deleted_records) {
+      index_t target = capacity;
+      if (capacity * load_factor < n_append + used_records)
+        target = initial_capacity(
+            std::max((index_t)((n_append + used_records) / load_factor),
+                     capacity * (index_t)expand_factor));
+      if constexpr (incremental)
+        start_resize(target);
+      else
+        rehash(target);
+    }
+  }
+
+  // fill an empty block with edges of level > 1 without probing: sorted by
+  // home slot, entry i goes to the later of its home and the slot after
+  // entry i - 1, i.e. i plus the prefix max of home[j] - j. Every slot from
+  // an entry's home to its own is taken, so lookups find it as if it had
+  // been inserted. Under Robin Hood entries with the same home go by key,
+  // the order insert_slot leaves them in. The few that run past the last
+  // slot wrap around through insert_slot
+  void place_sorted(const parlay::sequence<std::pair<key_t, val_t>> &edges) {
+    size_t n = edges.size();
+    // (home, entry), every key hashed once
+    auto sorted = parlay::integer_sort(
+        parlay::delayed_seq<std::pair<index_t, entry_t>>(
+            n,
+            [&](size_t i) {
+              auto [k, l] = edges[i];
+              assert(k <= entry_t::max_key && l > 1 &&
+                     l <= entry_t::max_level);
+              return std::pair(firstIndex(k), entry_t(k, l));
+            }),
+        [](const std::pair<index_t, entry_t> &e) { return e.first; });
+    if constexpr (robin_hood) {
+      // runs of one home are a few entries long
+      parlay::parallel_for(0, n, [&](size_t i) {
+        if (i > 0 && sorted[i - 1].first == sorted[i].first)
+          return;
+        size_t e = i + 1;
+        while (e < n && sorted[e].first == sorted[i].first)
+          e++;
+        std::sort(sorted.begin() + i, sorted.begin() + e,
+                  [](const auto &a, const auto &b) {
+                    return a.second.key() < b.second.key();
+                  });
       });
-      update_top_down();
-      // delete[] old_navigation;
-      // delete[] old_records;
-      free(old_records_navigation);
+    }
+    auto shift = parlay::scan_inclusive(
+        parlay::delayed_seq<int64_t>(
+            n, [&](size_t i) { return (int64_t)sorted[i].first - (int64_t)i; }),
+        parlay::maxm<int64_t>());
+    auto records = get_records();
+    size_t num_blocks = (n + seq_threshold - 1) / seq_threshold;
+    auto partial = parlay::tabulate(num_blocks, [&](size_t b) {
+      std::array<index_t, 32> c{};
+      size_t e = std::min(n, (b + 1) * seq_threshold);
+      for (size_t i = b * seq_threshold; i < e; i++) {
+        entry_t x = sorted[i].second;
+        c[x.level() - 1]++;
+        size_t slot = shift[i] + i;
+        if (slot >= capacity)
+          continue;
+        records[slot] = x;
+        if constexpr (swiss)
+          get_ctrl()[slot] = ctrl_tag(x.key());
+      }
+      return c;
+    });
+    auto counts = get_level_counts();
+    for (auto &c : partial)
+      for (val_t l = 1; l < 32; l++)
+        counts[l] += c[l];
+    used_records = n;
+    // slots only grow along the order, the ones that wrap are a suffix
+    size_t w = n;
+    while (w > 0 && shift[w - 1] + (int64_t)w - 1 >= (int64_t)capacity)
+      w--;
+    for (size_t i = w; i < n; i++)
+      insert_slot(sorted[i].second.key(), sorted[i].second.level());
+  }
+
+  // Incremental resize. The new block takes over right away, the old one
+  // stays behind with its entries until migrate() has moved every block.
+  // Lookups try the new table first, an entry is in exactly one of them:
+  // migrate, update and remove leave a tombstone in the old table
+  void start_resize(index_t new_capacity) {
+    if (resizing()) // the current table holds everything the batch needs
+      finish_resize();
+    flush(); // fetch reads the old tree until the move is done
+    auto old_block = records_navigation;
+    auto old_capacity = capacity;
+    capacity = new_capacity;
+    records_navigation = allocate_block(capacity);
+    init_block();
+    memcpy(get_level_counts(), old_block, counts_bytes);
+    deleted_records = 0;
+    if (sample_counts) {
+      free_sample_counts(old_capacity);
+      sample_counts = alloc_sample_counts();
+    }
+    get_state()->old_block = old_block;
+    get_state()->old_capacity = old_capacity;
+    get_state()->cursor = 0;
+    this->count_resize(0); // migrate() counts the entries it moves
+    publish();
+  }
+  // move the live entries of the next m old blocks, the new table is
+  // repaired by the batch that called it
+  void migrate(index_t m) {
+    auto rs = get_state();
+    index_t leaves = rs->old_capacity / B;
+    index_t end = std::min(leaves, rs->cursor + m);
+    auto old_records = records_of(rs->old_block);
+    size_t s = (size_t)rs->cursor * B, n = (size_t)(end - rs->cursor) * B;
+    auto live = [&](size_t i) {
+      return old_records[s + i] != empty_entry &&
+             old_records[s + i] != deleted_entry;
+    };
+    apply_batch(
+        n, [&](size_t i) { return old_records[s + i].key(); },
+        [&](size_t i) -> op_delta {
+          if (!live(i))
+            return {0, 0, 0};
+          entry_t e = old_records[s + i];
+          int tombstones = insert_slot(e.key(), e.level());
+          this->count_moved(sizeof(entry_t));
+          if constexpr (!concurrent)
+            retire_old(s + i);
+          return {tombstones, e.level(), e.level()};
+        });
+    if constexpr (concurrent) {
+      // fetch finds the moved entries in the new tree before they leave
+      // the old table
+      update_top_down(0, capacity >= seq_threshold);
+      for_batch(n, [&](size_t i) {
+        if (live(i))
+          retire_old(s + i);
+      });
+    }
+    __atomic_store_n(&rs->cursor, end, __ATOMIC_RELAXED);
+    if (end == leaves) {
+      char *old = rs->old_block;
+      __atomic_store_n(&rs->old_block, nullptr, __ATOMIC_RELEASE);
+      retire_block(old, rs->old_capacity);
+    }
+  }
+  // the share of the old table a batch of n ops moves, at least as many
+  // slots as the batch may add so the old table is gone before the new
+  // one fills up
+  void migrate_step(size_t n) {
+    [[maybe_unused]] auto timed = this->time(nghs_phase::ensure_capacity);
+    if (resizing())
+      migrate(std::max((index_t)Resize::blocks_per_batch,
+                       (index_t)(2 * n / B + 1)));
+  }
+  void finish_resize() {
+    migrate(get_state()->old_capacity / B);
+    update_top_down(0, capacity >= seq_threshold);
+  }
+  // tombstone old slot i, the old tree is left as is: entries only ever
+  // leave the old table, so its masks still cover what is left
+  void retire_old(size_t i) {
+    auto rs = get_state();
+    records_of(rs->old_block)[i] = deleted_entry;
+    if constexpr (swiss)
+      ctrl_of(rs->old_block, rs->old_capacity)[i] = ctrl_deleted;
+  }
+  // slot of k in the old table, old capacity if it is not there
+  index_t locate_old(key_t k) {
+    auto rs = get_state();
+    return locate_in(rs->old_block, rs->old_capacity, k);
+  }
+  // entries of the blocks not moved yet with a level in bits, appended to
+  // out, see fetch_top_down. Returns whether there was an old table
+  template <class T, class Scan>
+  bool fetch_old(const view &t, parlay::sequence<T> &out, uint32_t bits,
+                 Scan &&scan, std::atomic<index_t> &fetched) {
+    if constexpr (!incremental)
+      return false;
+    auto rs = state_of(t.block);
+    char *old = __atomic_load_n(&rs->old_block, __ATOMIC_ACQUIRE);
+    if (old == nullptr)
+      return false;
+    index_t leaves = rs->old_capacity / B;
+    auto records = records_of(old);
+    auto navigation = navigation_of(old, rs->old_capacity);
+    if ((navigation[0] & bits) == 0)
+      return true;
+    index_t cursor = __atomic_load_n(&rs->cursor, __ATOMIC_RELAXED);
+    for (index_t b = cursor; b < leaves && fetched < out.size(); b++) {
+      if ((navigation[leaf_of_block(leaves, b)] & bits) == 0)
+        continue;
+      T found[B + 4];
+      index_t c = scan(records + (size_t)b * B, found);
+      for (index_t j = 0; j < c && fetched < out.size(); j++)
+        out[fetched++] = found[j];
+    }
+    return true;
+  }
+
+  // called after deletions: give memory back once the table is mostly empty
+  // and drop tombstones once they make up a large part of the probe chains
+  void maybe_compact() {
+    if (small_mode && used_records <= small_capacity / 2)
+      return demote();
+    auto target = initial_capacity(used_records * 2);
+    if (used_records * shrink_ratio < capacity && target < capacity)
+      rehash(target);
+    else if (deleted_records * tombstone_ratio > capacity)
+      rehash(capacity);
+  }
+
+  template <class F> static void for_batch(size_t n, F &&f) {
+    if (n < seq_threshold) {
+      for (size_t i = 0; i < n; i++)
+        f(i);
+    } else
+      parlay::parallel_for(0, n, f);
+  }
+
+  void prefetch_home(const view &t, key_t k) {
+    if (t.cap == 0) // small mode has no slots to fetch
+      return;
+    index_t h = hash_key(k) % t.cap;
+    __builtin_prefetch(records_of(t.block) + h);
+    if constexpr (swiss)
+      __builtin_prefetch(ctrl_of(t.block, t.cap) + h / B * B);
+  }
+  // run f(i) for i in [s, e) in order, the home slot of key(i) in t is
+  // requested prefetch_distance ops ahead so the misses of a window overlap
+  template <class K, class F>
+  void run_prefetched(const view &t, size_t s, size_t e, K &&key, F &&f) {
+    for (size_t i = s; i < std::min(e, s + prefetch_distance); i++)
+      prefetch_home(t, key(i));
+    for (size_t i = s; i < e; i++) {
+      if (i + prefetch_distance < e)
+        prefetch_home(t, key(i + prefetch_distance));
+      f(i);
+    }
+  }
+  // for_batch in prefetched runs of seq_threshold ops
+  template <class K, class F>
+  void for_batch_prefetched(const view &t, size_t n, K &&key, F &&f) {
+    size_t num_blocks = (n + seq_threshold - 1) / seq_threshold;
+    if (num_blocks <= 1)
+      run_prefetched(t, 0, n, key, f);
+    else
+      parlay::parallel_for(0, num_blocks, [&](size_t b) {
+        run_prefetched(t, b * seq_threshold,
+                       std::min(n, (b + 1) * seq_threshold), key, f);
+      });
+  }
+
+  // what one insert/update/remove did to the table
+  struct op_delta {
+    int tombstones;   // change in tombstones
+    val_t old_level;  // level of the key before, 0 if absent
+    val_t new_level;  // level of the key after, 0 if removed
+  };
+  // [l] for the change of level l, [33] for the change of tombstones
+  using level_delta = std::array<long, 34>;
+  static void add_delta(level_delta &h, const op_delta &d) {
+    h[33] += d.tombstones;
+    h[d.old_level]--; // level 0 and 1 are not counted
+    h[d.new_level]++;
+  }
+  // run f(i) -> op_delta over a batch and fold the deltas into the counters,
+  // large batches reduce per-block histograms instead of sharing atomics.
+  // key(i) is the key op i probes for, prefetched ahead of the op
+  template <class K, class F> void apply_batch(size_t n, K &&key, F &&f) {
+    [[maybe_unused]] auto timed = this->time(nghs_phase::probe);
+    level_delta h{};
+    view t = own_view();
+    if (n < seq_threshold) {
+      run_prefetched(t, 0, n, key, [&](size_t i) { add_delta(h, f(i)); });
+    } else {
+      size_t num_blocks = (n + seq_threshold - 1) / seq_threshold;
+      auto partial = parlay::tabulate(num_blocks, [&](size_t b) {
+        level_delta ph{};
+        run_prefetched(t, b * seq_threshold,
+                       std::min(n, (b + 1) * seq_threshold), key,
+                       [&](size_t i) { add_delta(ph, f(i)); });
+        return ph;
+      });
+      for (auto &ph : partial)
+        for (size_t l = 0; l < 34; l++)
+          h[l] += ph[l];
+    }
+    deleted_records += h[33];
+    auto counts = get_level_counts();
+    for (val_t l = 2; l < 33; l++) {
+      shared_store(counts[l - 1], (index_t)(counts[l - 1] + h[l]));
+      used_records += h[l];
     }
   }
 
   // atomic utils
-  bool cas_64(entry_t *_ptr, entry_t _oval, entry_t _nval) {
-    uint64_t *ptr = reinterpret_cast<uint64_t *>(_ptr);
-    uint64_t oval = *(reinterpret_cast<uint64_t *>(&_oval));
-    uint64_t nval = *(reinterpret_cast<uint64_t *>(&_nval));
-    return __sync_bool_compare_and_swap(ptr, oval, nval);
+  using word_t = typename entry_t::word_type;
+  static word_t to_word(entry_t e) {
+    word_t w;
+    memcpy(&w, static_cast<void *>(&e), sizeof(word_t));
+    return w;
+  }
+  bool cas_entry(entry_t *_ptr, entry_t _oval, entry_t _nval) {
+    word_t *ptr = reinterpret_cast<word_t *>(_ptr);
+    return __sync_bool_compare_and_swap(ptr, to_word(_oval), to_word(_nval));
   }
   uint32_t fetch_and_or(uint32_t *ptr, uint32_t nval) {
     return __sync_fetch_and_or(ptr, nval);
   }
+  static entry_t load_entry(entry_t *_ptr) {
+    word_t val =
+        __atomic_load_n(reinterpret_cast<word_t *>(_ptr), __ATOMIC_RELAXED);
+    entry_t e;
+    memcpy(static_cast<void *>(&e), &val, sizeof(entry_t));
+    return e;
+  }
 
-  // complete bianry tree utils
+  // complete Fanout-ary tree utils
   // make sure capacity is dividable by B
   uint32_t get_leaf_size() {
     assert(capacity % B == 0);
     return capacity / B;
   }
-  uint32_t get_internal_node_size() { return get_leaf_size() - 1; }
-  uint32_t get_tree_size() { return get_leaf_size() * 2 - 1; }
+  // fewest internal nodes covering the leaves, only the last one may have
+  // less than Fanout children
+  static index_t internal_nodes(index_t leaves) {
+    return (leaves + Fanout - 3) / (Fanout - 1);
+  }
+  // masks stored, the missing children of the last internal node are kept
+  // as empty masks so sibling groups can be loaded whole
+  static index_t navigation_length(index_t leaves) {
+    auto internal = internal_nodes(leaves);
+    return internal ? Fanout * internal + 1 : 1;
+  }
+  static index_t tree_size(index_t leaves) {
+    return internal_nodes(leaves) + leaves;
+  }
+  uint32_t get_internal_node_size() { return internal_nodes(get_leaf_size()); }
+  uint32_t get_tree_size() { return tree_size(get_leaf_size()); }
+  // Leaves fill the last one or two depths of the heap layout. Blocks are
+  // numbered in tree order, deepest leaves first, so a left-to-right walk of
+  // the tree visits the blocks in slot order
+  static index_t deepest_first(index_t n) {
+    if constexpr (Fanout == 2)
+      return ((uint32_t)1 << (31 - __builtin_clz(n))) - 1;
+    // depth d starts at (Fanout^d - 1) / (Fanout - 1)
+    index_t first = 0, width = 1;
+    while (first + width < n) {
+      first += width;
+      width *= Fanout;
+    }
+    return first;
+  }
+  uint32_t get_deepest_first() { return deepest_first(get_tree_size()); }
+  // leaf of block b in a tree over `leaves` blocks
+  static index_t leaf_of_block(index_t leaves, index_t b) {
+    auto n = tree_size(leaves);
+    auto f = deepest_first(n);
+    return b < n - f ? f + b : b - (n - f) + internal_nodes(leaves);
+  }
   uint32_t get_tree_index(index_t i) {
-    return get_internal_node_size() + i / B;
+    return leaf_of_block(get_leaf_size(), i / B);
+  }
+  // first slot of the block behind a leaf
+  static index_t leaf_start(index_t leaves, index_t leaf) {
+    auto n = tree_size(leaves);
+    auto f = deepest_first(n);
+    return (leaf >= f ? leaf - f : leaf - internal_nodes(leaves) + n - f) * B;
+  }
+  index_t get_leaf_start(index_t leaf) {
+    return leaf_start(get_leaf_size(), leaf);
+  }
+  static index_t get_first_child(index_t i) { return Fanout * i + 1; }
+  static index_t get_parent(index_t i) { return (i - 1) / Fanout; }
+  bool isleaf(index_t k) { return k >= get_internal_node_size(); }
+  // bit j set for every child j of internal node i that exists
+  uint32_t real_children(index_t i) {
+    index_t n = std::min(Fanout, get_tree_size() - get_first_child(i));
+    return (uint32_t)(((uint64_t)1 << n) - 1);
+  }
+  // bit j set for every child j of i whose mask holds one of bits
+  uint32_t children_with(index_t i, uint32_t bits) {
+    return nghs_simd::masks_any<Fanout>(get_navigation() + get_first_child(i),
+                                        bits);
+  }
+  // bit j set for every child j of i marked by update_binary_tree
+  uint32_t children_marked(index_t i) {
+    auto dirty = get_dirty();
+    index_t first = get_first_child(i);
+    uint64_t w = __atomic_load_n(dirty + first / 32, __ATOMIC_RELAXED) >>
+                 (first % 32);
+    if (first % 32 + Fanout > 32)
+      w |= (uint64_t)__atomic_load_n(dirty + first / 32 + 1,
+                                     __ATOMIC_RELAXED)
+           << (32 - first % 32);
+    return (uint32_t)(w & (((uint64_t)1 << Fanout) - 1));
+  }
+  bool is_dirty(index_t i) {
+    return __atomic_load_n(get_dirty() + i / 32, __ATOMIC_RELAXED) >>
+               (i % 32) & 1;
+  }
+  // mark node i, false if it was marked already
+  bool mark_dirty(index_t i) {
+    auto w = get_dirty() + i / 32;
+    uint32_t bit = (uint32_t)1 << (i % 32);
+    if (__atomic_load_n(w, __ATOMIC_RELAXED) & bit)
+      return false;
+    return (__atomic_fetch_or(w, bit, __ATOMIC_RELAXED) & bit) == 0;
+  }
+  void clear_dirty(index_t i) {
+    __atomic_fetch_and(get_dirty() + i / 32, ~((uint32_t)1 << (i % 32)),
+                       __ATOMIC_RELAXED);
+  }
+  uint32_t children_mask(index_t i) {
+    return nghs_simd::masks_or<Fanout>(get_navigation() + get_first_child(i));
+  }
+  // run f(c) on the children c of i picked by hits, in tree order unless
+  // par is set and more than one is picked
+  template <class F>
+  void for_children(index_t i, uint32_t hits, bool par, F &&f) {
+    index_t first = get_first_child(i);
+    if (!par || (hits & (hits - 1)) == 0) {
+      for (; hits; hits &= hits - 1)
+        f(first + __builtin_ctz(hits));
+      return;
+    }
+    if constexpr (Fanout == 2) {
+      parlay::par_do([&]() { f(first); }, [&]() { f(first + 1); });
+    } else {
+      index_t picked[Fanout];
+      uint32_t n = 0;
+      for (; hits; hits &= hits - 1)
+        picked[n++] = first + __builtin_ctz(hits);
+      parlay::parallel_for(0, n, [&](size_t j) { f(picked[j]); }, 1);
+    }
   }
-  static index_t get_left_child_id(index_t i) { return (i << 1) + 1; }
-  static index_t get_right_child_id(index_t i) { return (i << 1) + 2; }
-  bool isleaf(index_t k) { return k * 2 + 1 >= get_tree_size(); }
   static val_t get_bit_val(val_t l) {
     assert(l < 33);
     // l = 0 or 1 for empty/deleted entry
     return l > 1 ? (val_t)1 << (l - 1) : 0;
   }
 
-  // update from bottom to top
+  // level mask of the B entries at block, the SIMD kernels read unpacked
+  // (key, level) pairs, packed blocks take the plain loop
+  static uint32_t scan_mask(const entry_t *block) {
+    if constexpr (!packed)
+      return nghs_simd::block_level_mask<B>((const uint32_t *)block);
+    else {
+      uint32_t m = 0;
+      for (index_t i = 0; i < B; i++)
+        m |= get_bit_val(block[i].level());
+      return m;
+    }
+  }
+  // keys of the level l entries among the B at block, in slot order,
+  // out needs room for B + 4 keys
+  static index_t scan_keys(const entry_t *block, val_t l, key_t *out) {
+    if constexpr (!packed)
+      return nghs_simd::block_match<B>((const uint32_t *)block, l, out);
+    else {
+      index_t c = 0;
+      for (index_t i = 0; i < B; i++)
+        if (block[i].level() == l)
+          out[c++] = block[i].key();
+      return c;
+    }
+  }
+  uint32_t block_mask(index_t leaf) {
+    return scan_mask(get_records() + get_leaf_start(leaf));
+  }
+  index_t block_keys(index_t leaf, val_t l, key_t *out) {
+    return scan_keys(get_records() + get_leaf_start(leaf), l, out);
+  }
+
+  // update from bottom to top, the first thread to mark a node goes on to
+  // its parent
   void update_binary_tree(index_t k) {
-    auto navigation = get_navigation();
     index_t i = get_tree_index(k);
-    // fetch_and_or(&navigation[i], 1);
-    navigation[i] = 1;
+    if (!mark_dirty(i))
+      return;
     while (i) {
-      i = (i - 1) / 2;
-      if (navigation[i] == 1)
+      i = get_parent(i);
+      if (!mark_dirty(i))
         return;
-      // fetch_and_or(&navigation[i], 1);
-      navigation[i] = 1;
     }
   }
 
-  // work efficient update augmented value
-  void update_top_down(index_t root = 0) {
+  // work efficient update augmented value, a mask is only written once its
+  // new value is known
+  void update_top_down(index_t root = 0, bool par = true) {
     auto navigation = get_navigation();
-    auto records = get_records();
-    if (navigation[root] == 1) { // root got marked
+    if (is_dirty(root)) { // root got marked
+      clear_dirty(root);
+      this->count_repaired();
       if (isleaf(root)) {
         // leaf in binary tree needs to be mapped to a block from hash table
-
-        index_t start = (root - get_internal_node_size()) * B;
-        navigation[root] = 0;
-        for (auto i = start; i < start + B; i++)
-          navigation[root] |= get_bit_val(records[i].v);
+        navigation[root] = block_mask(root);
         return;
       }
-      auto l = get_left_child_id(root);
-      auto r = get_right_child_id(root);
-      parlay::par_do(
-          [&]() { // if (l < get_tree_size())
-            update_top_down(l);
-          },
-          [&]() { // if (r < get_tree_size())
-            update_top_down(r);
-          });
-      navigation[root] = navigation[l] | navigation[r];
+      for_children(root, children_marked(root), par,
+                   [&](index_t c) { update_top_down(c, par); });
+      navigation[root] = children_mask(root);
+      if (sample_counts)
+        update_sample_counts(root);
     }
   }
-  void fetch_top_down(parlay::sequence<key_t> &nghs, uint32_t level,
-                      std::atomic<key_t> &fetched, index_t root = 0) {
-    // level l should have lth bit set which is l - 1
+
+  // every mask from scratch, bottom up, for a tree with nothing marked
+  void build_navigation(index_t root = 0) {
     auto navigation = get_navigation();
+    if (isleaf(root)) {
+      navigation[root] = block_mask(root);
+      return;
+    }
+    for_children(root, real_children(root), true,
+                 [&](index_t c) { build_navigation(c); });
+    navigation[root] = children_mask(root);
+  }
+
+  // 32 counters per internal node of a table with capacity cap, they come
+  // from the arena or Alloc like the block
+  static size_t sample_counts_bytes(index_t cap) {
+    return sizeof(index_t) * 32 * internal_nodes(cap / B);
+  }
+  index_t *alloc_sample_counts() {
+    size_t bytes = sample_counts_bytes(capacity);
+    char *p = arena ? arena->allocate(bytes) : Alloc::allocate(bytes);
+    memset(p, 0, bytes);
+    return (index_t *)p;
+  }
+  // sample_counts was built for a table with capacity cap
+  void free_sample_counts(index_t cap) {
+    if (sample_counts)
+      release(arena, (char *)sample_counts, sample_counts_bytes(cap));
+    sample_counts = nullptr;
+  }
+  // add the per-level counts of the subtree rooted at node to c,
+  // a leaf is counted from its block
+  void add_subtree_counts(index_t node, index_t *c) {
+    if (isleaf(node)) {
+      auto records = get_records();
+      index_t start = get_leaf_start(node);
+      for (auto i = start; i < start + B; i++)
+        if (records[i].level() > 1)
+          c[records[i].level() - 1]++;
+      return;
+    }
+    for (val_t l = 1; l < 32; l++)
+      c[l] += sample_counts[(size_t)node * 32 + l];
+  }
+  void update_sample_counts(index_t node) {
+    auto c = sample_counts + (size_t)node * 32;
+    memset(c, 0, sizeof(index_t) * 32);
+    for_children(node, real_children(node), false,
+                 [&](index_t child) { add_subtree_counts(child, c); });
+  }
+  index_t subtree_count(index_t node, val_t level) {
+    if (isleaf(node)) {
+      auto records = get_records();
+      index_t start = get_leaf_start(node);
+      index_t c = 0;
+      for (auto i = start; i < start + B; i++)
+        c += records[i].level() == level;
+      return c;
+    }
+    return sample_counts[(size_t)node * 32 + level - 1];
+  }
+  // count every internal node bottom up
+  void build_sample_counts(index_t root = 0) {
+    if (isleaf(root))
+      return;
+    for_children(root, real_children(root), true,
+                 [&](index_t c) { build_sample_counts(c); });
+    update_sample_counts(root);
+  }
+  // the r-th level l entry in tree order, one descent
+  key_t select(val_t level, index_t r) {
+    if (is_small()) {
+      for (index_t i = 0; i < used_records; i++)
+        if (small_records[i].level() == level && r-- == 0)
+          return small_records[i].key();
+      assert(false);
+    }
+    index_t node = 0;
+    while (!isleaf(node)) {
+      // children without the level hold nothing to skip over
+      uint32_t hits = children_with(node, get_bit_val(level));
+      for (; hits; hits &= hits - 1) {
+        index_t c = get_first_child(node) + __builtin_ctz(hits);
+        auto cc = subtree_count(c, level);
+        if (r < cc) {
+          node = c;
+          break;
+        }
+        r -= cc;
+      }
+      assert(hits);
+    }
+    auto records = get_records();
+    index_t start = get_leaf_start(node);
+    for (auto i = start; i < start + B; i++)
+      if (records[i].level() == level && r-- == 0)
+        return records[i].key();
+    assert(false);
+    return reserved_key;
+  }
+  // leaves marked by the running batch
+  parlay::sequence<index_t> dirty_leaves(index_t root = 0) {
+    if (!is_dirty(root))
+      return {};
+    if (isleaf(root))
+      return parlay::sequence<index_t>(1, root);
+    index_t first = get_first_child(root);
+    parlay::sequence<parlay::sequence<index_t>> parts(Fanout);
+    for_children(root, children_marked(root), true,
+                 [&](index_t c) { parts[c - first] = dirty_leaves(c); });
+    return parlay::flatten(parts);
+  }
+  // close the holes of the cluster starting at slot s: every live entry moves
+  // back to its home or right behind its predecessor, whichever comes later
+  void shift_cluster(index_t s) {
     auto records = get_records();
-    assert(root < get_tree_size());
-    if ((navigation[root] & ((uint32_t)1 << (level - 1))) == 0)
+    index_t w = s; // first slot not taken by an already shifted entry
+    for (index_t j = s; records[j] != empty_entry;
+         j = incrementIndex(j)) {
+      entry_t e = records[j];
+      if (e != deleted_entry) {
+        index_t h = firstIndex(e.key());
+        index_t target =
+            probe_distance(h, j) >= probe_distance(w, j) ? w : h;
+        w = incrementIndex(target);
+        if (target == j)
+          continue;
+        records[target] = e;
+        update_binary_tree(target);
+      }
+      records[j] = empty_entry;
+      update_binary_tree(j);
+    }
+  }
+  // end of a batch of n ops: Robin Hood tombstones go, the tree catches up
+  // unless repair is lazy
+  void repair(size_t n) {
+    [[maybe_unused]] auto timed = this->time(nghs_phase::repair);
+    // level 1 edges already in the table leave a tombstone too
+    if (robin_hood && deleted_records)
+      backward_shift();
+    if constexpr (!lazy)
+      update_top_down(0, n >= seq_threshold);
+  }
+  // Robin Hood deletion, run after the tombstones of a batch are written.
+  // They all sit in marked blocks, find the clusters holding them and shift
+  // every cluster once, clusters are disjoint so they go in parallel
+  void backward_shift() {
+    auto records = get_records();
+    auto leaves = dirty_leaves();
+    auto starts = parlay::flatten(parlay::map(leaves, [&](index_t leaf) {
+      parlay::sequence<index_t> s;
+      index_t start = get_leaf_start(leaf);
+      for (auto i = start; i < start + B; i++) {
+        if (records[i] != deleted_entry)
+          continue;
+        index_t j = i;
+        while (records[decrementIndex(j)] != empty_entry)
+          j = decrementIndex(j);
+        if (s.empty() || s.back() != j)
+          s.push_back(j);
+      }
+      return s;
+    }));
+    starts = parlay::remove_duplicates_ordered(
+        starts, [](index_t a, index_t b) { return a < b; });
+    for_batch(starts.size(), [&](auto c) { shift_cluster(starts[c]); });
+    deleted_records = 0;
+  }
+  // fill out with entries whose level bit is in bits, descending only
+  // into subtrees whose mask shares a bit with them. scan(block, found)
+  // writes the matches among the B entries at block to found, which has
+  // room for B + 4, and returns how many
+  template <class T, class Scan>
+  void fetch_top_down(const view &t, parlay::sequence<T> &out, uint32_t bits,
+                      Scan &&scan, std::atomic<index_t> &fetched,
+                      index_t root = 0) {
+    // level l should have lth bit set which is l - 1
+    auto navigation = navigation_of(t.block, t.cap);
+    index_t leaves = t.cap / B;
+    assert(root < tree_size(leaves));
+    if ((navigation[root] & bits) == 0)
       return;
-    if (fetched >= nghs.size())
+    if (fetched >= out.size())
+      return;
+    if (root >= internal_nodes(leaves)) {
+      // leaf in binary tree needs to be mapped to a block from hash table,
+      // its matches claim their output range with a single fetch_add
+      T found[B + 4];
+      index_t c = scan(records_of(t.block) + leaf_start(leaves, root), found);
+      size_t o = fetched.fetch_add(c);
+      for (index_t j = 0; j < c && o + j < out.size(); j++)
+        out[o + j] = found[j];
+      return;
+    }
+    uint32_t hits = nghs_simd::masks_any<Fanout>(
+        navigation + get_first_child(root), bits);
+    for_children(root, hits, true, [&](index_t c) {
+      fetch_top_down(t, out, bits, scan, fetched, c);
+    });
+  }
+  // the first `limit` leaves holding level l in tree order, i.e. by slot
+  void collect_leaves(parlay::sequence<index_t> &out, val_t level,
+                      size_t limit, index_t root = 0) {
+    auto navigation = get_navigation();
+    if (out.size() >= limit || (navigation[root] & get_bit_val(level)) == 0)
       return;
     if (isleaf(root)) {
-      // leaf in binary tree needs to be mapped to a block from hash table
-      index_t start = (root - get_internal_node_size()) * B;
+      out.push_back(root);
+      return;
+    }
+    uint32_t hits = children_with(root, get_bit_val(level));
+    if (limit - out.size() < seq_threshold) {
+      for_children(root, hits, false, [&](index_t c) {
+        collect_leaves(out, level, limit, c);
+      });
+      return;
+    }
+    // every child collects up to the limit, the later ones may overshoot
+    size_t room = limit - out.size();
+    index_t first = get_first_child(root);
+    parlay::sequence<parlay::sequence<index_t>> parts(Fanout);
+    for_children(root, hits, true, [&](index_t c) {
+      collect_leaves(parts[c - first], level, room, c);
+    });
+    for (auto &p : parts)
+      for (size_t i = 0; out.size() < limit && i < p.size(); i++)
+        out.push_back(p[i]);
+  }
+  // fetch_top_down that also moves every fetched entry to level `to`. Masks
+  // are repaired on the way back up, returns whether the subtree changed
+  bool relevel_top_down(parlay::sequence<key_t> &nghs, val_t from, val_t to,
+                        std::atomic<index_t> &fetched, index_t root = 0) {
+    auto navigation = get_navigation();
+    auto records = get_records();
+    if ((navigation[root] & get_bit_val(from)) == 0)
+      return false;
+    if (fetched >= nghs.size())
+      return false;
+    if (isleaf(root)) {
+      index_t start = get_leaf_start(root);
+      bool changed = false;
       for (auto i = start; i < start + B; i++) {
-        if (records[i].k == 0)
-          std::cout << "fetching " << records[i].k << " " << records[i].v << " "
-                    << level << std::endl;
-
-        if (records[i].v == level) {
+        if (records[i].level() == from) {
           auto o = fetched.fetch_add(1);
           if (o >= nghs.size())
-            return;
-          nghs[o] = records[i].k;
+            break;
+          nghs[o] = records[i].key();
+          records[i].set_level(to);
+          changed = true;
         }
       }
-      return;
+      if (changed)
+        navigation[root] = block_mask(root);
+      return changed;
     }
-    auto l = get_left_child_id(root);
-    auto r = get_right_child_id(root);
-    parlay::par_do(
-        [&]() { // if (l < get_tree_size())
-          fetch_top_down(nghs, level, fetched, l);
-        },
-        [&]() { // if (r < get_tree_size())
-          fetch_top_down(nghs, level, fetched, r);
-        });
+    index_t first = get_first_child(root);
+    std::array<bool, Fanout> changed{};
+    for_children(root, children_with(root, get_bit_val(from)), true,
+                 [&](index_t c) {
+                   changed[c - first] =
+                       relevel_top_down(nghs, from, to, fetched, c);
+                 });
+    bool any = false;
+    for (auto c : changed)
+      any |= c;
+    if (any) {
+      navigation[root] = children_mask(root);
+      if (sample_counts)
+        update_sample_counts(root);
+    }
+    return any;
   }
   //  batch insertion and batch deletion share the same insert function
   //  one can reach empty slot, delete slot or update record,
@@ -212,204 +1305,991 @@ private:
   //  used_records, all but update
   //  update records, needed for all
   //  update bitmap, needed for all
-  void insert(key_t k, val_t v) {
+  //  insert_slot places a level > 1 entry and returns the change in
+  //  tombstones: -1 when a deleted slot got reused
+  int insert_slot(key_t k, val_t v) {
     // std::cout << k << " " << v << std::endl;
-    if (v == 1) {
-      // process level 1 edge
-      if (!__sync_bool_compare_and_swap((uint32_t *)(&roommate),
-                                        (uint32_t)reserved_key, (uint32_t)k)) {
-        std::cout << "repeat inserting level 1 edge" << std::endl;
-        std::abort();
-      }
-      remove(k, false); // k might already exist.
-      return;
-    }
+    assert(v > 1);
     auto records = get_records();
-    assert(k != reserved_key);
+    assert(k <= entry_t::max_key && v <= entry_t::max_level);
     assert(k != roommate); // level 1 edge can only be deleted
     index_t i = firstIndex(k);
     index_t st = i;
     entry_t item(k, v);
+    if constexpr (robin_hood) {
+      // take the slot of any entry closer to its home and carry on with the
+      // evicted one, every slot written is marked
+      index_t d = 0;
+      for (index_t steps = 0; steps < capacity; steps++) {
+        entry_t e = load_entry(&records[i]);
+        if (e == empty_entry) {
+          if (cas_entry(&records[i], e, item)) {
+            update_binary_tree(i);
+            return 0;
+          }
+          continue;
+        }
+        if (e != deleted_entry) {
+          index_t de = probe_distance(firstIndex(e.key()), i);
+          if (de < d || (de == d && item.key() < e.key())) {
+            if (!cas_entry(&records[i], e, item))
+              continue;
+            update_binary_tree(i);
+            item = e;
+            d = de;
+          }
+        }
+        i = incrementIndex(i);
+        d++;
+      }
+      std::cerr << "hash table is full" << std::endl;
+      std::abort();
+    }
+    if constexpr (swiss) {
+      // only slots whose control byte says empty or deleted are tried
+      auto ctrl = get_ctrl();
+      index_t g = i / B;
+      uint64_t from = ~(uint64_t)0 << (i % B);
+      for (index_t n = 0; n <= get_leaf_size(); n++) {
+        uint64_t open = nghs_simd::bytes_high<B>(ctrl + (size_t)g * B) & from;
+        for (; open; open &= open - 1) {
+          i = g * B + __builtin_ctzll(open);
+          int tombstones = 0;
+          if (cas_entry(&records[i], deleted_entry, item))
+            tombstones = -1;
+          else if (!cas_entry(&records[i], empty_entry, item))
+            continue;
+          ctrl[i] = ctrl_tag(k);
+          update_binary_tree(i);
+          return tombstones;
+        }
+        g = (g + 1 == get_leaf_size()) ? 0 : g + 1;
+        from = ~(uint64_t)0;
+      }
+      std::cerr << "hash table is full" << std::endl;
+      std::abort();
+    }
     while (true) {
-      if (cas_64(&records[i], entry_t::deleted_entry, item) ||
-          cas_64(&records[i], entry_t::empty_entry, item)) {
+      if (cas_entry(&records[i], deleted_entry, item)) {
         update_binary_tree(i);
-        return;
+        return -1;
+      }
+      if (cas_entry(&records[i], empty_entry, item)) {
+        update_binary_tree(i);
+        return 0;
       }
       i = incrementIndex(i);
       if (i == st) {
-        std::cout << "hash table is full" << std::endl;
+        std::cerr << "hash table is full" << std::endl;
         std::abort();
       }
     }
   }
-  void update(key_t k, val_t v) {
-    if (k == roommate) // level 1 edge can only be deleted
-      return;
+  void set_roommate(key_t k) {
+    if (!__sync_bool_compare_and_swap(&roommate, reserved_key, k)) {
+      std::cerr << "repeat inserting level 1 edge" << std::endl;
+      std::abort();
+    }
+  }
+  op_delta insert(key_t k, val_t v) {
+    assert(k <= entry_t::max_key);
     if (v == 1) {
-      // process level 1 edge
-      if (!__sync_bool_compare_and_swap((uint32_t *)(&roommate),
-                                        (uint32_t)reserved_key, (uint32_t)k)) {
-        std::cout << "repeat inserting level 1 edge" << std::endl;
-        std::abort();
-      }
-      remove(k, false); // k might already exist.
-      return;
+      // process level 1 edge, k might already exist in the table
+      set_roommate(k);
+      auto d = remove_slot(k, false);
+      return {d.tombstones, d.old_level, 1};
+    }
+    return {insert_slot(k, v), 0, v};
+  }
+  op_delta update(key_t k, val_t v) {
+    if (v == 1 && k != roommate) // k might already exist
+      return insert(k, 1);
+    auto d = upsert(k, v, false);
+    if (d.old_level == 0) {
+      std::cerr << "key doesn't exist" << std::endl;
+      std::abort();
+    }
+    return d;
+  }
+  // set the level of k whether it is in the table or not, unless
+  // insert_missing is off: then a missing k is left out (old_level 0)
+  op_delta upsert(key_t k, val_t v, bool insert_missing = true) {
+    if (k == roommate) {
+      if (v == 1 || !insert_missing) // level 1 edge can only be deleted
+        return {0, 1, 1};
+      shared_store(roommate, reserved_key);
+      return {insert_slot(k, v), 1, v};
+    }
+    if (v == 1) {
+      if (!insert_missing && find(k) == 0)
+        return {0, 0, 0};
+      return insert(k, 1);
     }
+    assert(v <= entry_t::max_level);
     auto records = get_records();
-    index_t i = firstIndex(k);
-    index_t st = i;
-    while (records[i] != entry_t::empty_entry) {
-      if (records[i].k == k) {
-        records[i].v = v;
-        update_binary_tree(i);
-        return;
+    index_t i = locate(k);
+    if (i < capacity) {
+      val_t old = records[i].level();
+      records[i].set_level(v);
+      update_binary_tree(i);
+      return {0, old, v};
+    }
+    if (resizing()) {
+      // not moved yet, move it now with its new level
+      index_t j = locate_old(k);
+      if (j < get_state()->old_capacity) {
+        val_t old = records_of(get_state()->old_block)[j].level();
+        int tombstones = insert_slot(k, v);
+        retire_old(j);
+        return {tombstones, old, v};
       }
-      i = incrementIndex(i);
-      if (i == st)
-        break;
     }
-    std::cout << "key doesn't exist" << std::endl;
-    std::abort();
+    if (!insert_missing)
+      return {0, 0, 0};
+    return {insert_slot(k, v), 0, v};
   }
-  void remove(key_t k, bool check = true) {
+  op_delta remove(key_t k, bool check = true) {
     // std::cout << k << std::endl;
     // process level 1 edge
     if (k == roommate) {
-      roommate = reserved_key;
-      return;
+      shared_store(roommate, reserved_key);
+      return {0, 1, 0};
     }
+    return remove_slot(k, check);
+  }
+  // remove k from the records only, the roommate is left alone
+  op_delta remove_slot(key_t k, bool check) {
     auto records = get_records();
-    index_t i = firstIndex(k);
-    int st = i;
-    while (records[i] != entry_t::empty_entry) {
-      if (records[i].k == k) {
-        assert(records[i].v != 0);
-        records[i] = entry_t::deleted_entry; // mark slot as deleted
-        update_binary_tree(i);
-        return;
+    index_t i = locate(k);
+    if (i == capacity && resizing()) {
+      // the old table keeps its tombstones out of deleted_records
+      index_t j = locate_old(k);
+      if (j < get_state()->old_capacity) {
+        val_t old = records_of(get_state()->old_block)[j].level();
+        retire_old(j);
+        return {0, old, 0};
       }
-      i = incrementIndex(i);
+    }
+    if (i == capacity) {
+      if (check) {
+        std::cerr << "remove non-existent item" << std::endl;
+        std::abort();
+      }
+      return {0, 0, 0};
+    }
+    val_t old = records[i].level();
+    assert(old != 0);
+    // mark slot as deleted, Robin Hood shifts it away after the batch
+    records[i] = deleted_entry;
+    if constexpr (swiss)
+      get_ctrl()[i] = ctrl_deleted;
+    update_binary_tree(i);
+    return {1, old, 0};
+  }
+  // slot holding k, capacity if k is not in the table
+  index_t locate(key_t k) { return locate_in(records_navigation, capacity, k); }
+  // the same in the table of `block` with cap slots
+  index_t locate_in(char *block, index_t cap, key_t k) {
+    auto records = records_of(block);
+    index_t i = hash_key(k) % cap;
+    if constexpr (swiss) {
+      // candidates are the tag matches in front of the first empty slot
+      auto ctrl = ctrl_of(block, cap);
+      uint8_t tag = ctrl_tag(k);
+      index_t g = i / B;
+      uint64_t from = ~(uint64_t)0 << (i % B);
+      for (index_t n = 0; n <= cap / B; n++) {
+        auto group = ctrl + (size_t)g * B;
+        uint64_t empty = nghs_simd::bytes_equal<B>(group, ctrl_empty) & from;
+        uint64_t hits = nghs_simd::bytes_equal<B>(group, tag) & from;
+        if (empty)
+          hits &= (empty & (0 - empty)) - 1;
+        for (; hits; hits &= hits - 1) {
+          index_t j = g * B + __builtin_ctzll(hits);
+          if (load_entry(&records[j]).key() == k)
+            return j;
+        }
+        if (empty)
+          return cap;
+        g = (g + 1 == cap / B) ? 0 : g + 1;
+        from = ~(uint64_t)0;
+      }
+      return cap;
+    }
+    index_t st = i;
+    for (index_t d = 0;; d++) {
+      entry_t e = load_entry(&records[i]);
+      if (e == empty_entry)
+        break;
+      if (e.key() == k)
+        return i;
+      if (probe_past(i, d)) // Robin Hood never has an old table
+        break;
+      i = (i + 1 == cap) ? 0 : i + 1;
       if (i == st)
         break;
     }
-    if (check) {
-      std::cout << "remove non-existent item" << std::endl;
+    return cap;
+  }
+  val_t find(key_t k) { return find_in(own_view(), k); }
+  val_t find_in(const view &t, key_t k) {
+    if (k == shared_load(roommate))
+      return 1;
+    if (t.cap == 0) {
+      index_t i = small_locate(k);
+      return i == used_records ? 0 : small_records[i].level();
+    }
+    if constexpr (incremental) {
+      // entries reach the new table before they leave the old one, so
+      // looking at the old one first cannot miss an entry on the move
+      auto rs = state_of(t.block);
+      char *old = __atomic_load_n(&rs->old_block, __ATOMIC_ACQUIRE);
+      if (old) {
+        index_t j = locate_in(old, rs->old_capacity, k);
+        if (j < rs->old_capacity) {
+          // tombstoned since, then k is in the new table
+          entry_t e = load_entry(records_of(old) + j);
+          if (e.key() == k)
+            return e.level();
+        }
+      }
+    }
+    index_t i = locate_in(t.block, t.cap, k);
+    if (i == t.cap)
+      return 0;
+    // a concurrent reader's block can lose k to a newer one meanwhile
+    entry_t e = load_entry(records_of(t.block) + i);
+    return e.key() == k ? e.level() : 0;
+  }
+
+  // small mode, batches are at most small_capacity long and run in order
+  bool is_small() const { return capacity == 0; }
+  // position of k among the inline entries, used_records if absent
+  index_t small_locate(key_t k) {
+    index_t i = 0;
+    while (i < used_records && small_records[i].key() != k)
+      i++;
+    return i;
+  }
+  void small_insert(key_t k, val_t v) {
+    assert(k <= entry_t::max_key && v <= entry_t::max_level);
+    if (v == 1) {
+      set_roommate(k);
+      small_remove_slot(k, false);
+      return;
+    }
+    assert(used_records < small_capacity);
+    small_records[used_records++] = entry_t(k, v);
+  }
+  void small_update(key_t k, val_t v) {
+    if (v == 1 && k != roommate)
+      return small_insert(k, 1);
+    if (!small_upsert(k, v, false)) {
+      std::cerr << "key doesn't exist" << std::endl;
       std::abort();
     }
   }
-  val_t find(key_t k) {
+  // upsert() on the inline entries, returns whether k was there before
+  bool small_upsert(key_t k, val_t v, bool insert_missing = true) {
+    if (k == roommate) {
+      if (v == 1 || !insert_missing) // level 1 edge can only be deleted
+        return true;
+      roommate = reserved_key;
+      small_insert(k, v);
+      return true;
+    }
+    index_t i = small_locate(k);
+    bool present = i < used_records;
+    if (v == 1) {
+      if (present || insert_missing)
+        small_insert(k, 1);
+    } else if (present)
+      small_records[i].set_level(v);
+    else if (insert_missing)
+      small_insert(k, v);
+    return present;
+  }
+  void small_remove(key_t k) {
     if (k == roommate)
-      return 1;
-    auto records = get_records();
-    index_t i = firstIndex(k);
-    index_t st = i;
-    while (records[i] != entry_t::empty_entry) {
-      if (records[i].k == k)
-        return records[i].v;
-      i = incrementIndex(i);
-      if (i == st)
-        break;
+      roommate = reserved_key;
+    else
+      small_remove_slot(k, true);
+  }
+  void small_remove_slot(key_t k, bool check) {
+    index_t i = small_locate(k);
+    if (i < used_records)
+      small_records[i] = small_records[--used_records];
+    else if (check) {
+      std::cerr << "remove non-existent item" << std::endl;
+      std::abort();
+    }
+  }
+  // move the inline entries into a hash table with room for n more
+  void promote(index_t n) {
+    index_t m = used_records;
+    entry_t moved[small_capacity];
+    std::copy(small_records, small_records + m, moved);
+    capacity = initial_capacity((index_t)((m + n) / load_factor));
+    records_navigation = allocate_block(capacity);
+    init_block();
+    auto counts = get_level_counts();
+    for (index_t j = 0; j < m; j++) {
+      insert_slot(moved[j].key(), moved[j].level());
+      counts[moved[j].level() - 1]++;
     }
-    return 0;
+    update_top_down(0, false);
+  }
+  // move the live entries back inline, they have to fit
+  void demote() {
+    assert(used_records <= small_capacity);
+    if (resizing())
+      finish_resize();
+    auto records = get_records();
+    entry_t kept[small_capacity];
+    index_t m = 0;
+    for (index_t i = 0; i < capacity; i++)
+      if (records[i] != empty_entry && records[i] != deleted_entry)
+        kept[m++] = records[i];
+    free_block(records_navigation, capacity);
+    free_sample_counts(capacity);
+    capacity = 0;
+    deleted_records = 0;
+    std::copy(kept, kept + m, small_records);
+  }
+
+  template <uint32_t, class...> friend class nghs_graph;
+  // adopt a block of block_bytes(_capacity) handed out by the arena
+  nghs_ht(index_t _capacity, char *block, nghs_arena *_arena)
+      : roommate(reserved_key), capacity(_capacity), used_records(0),
+        deleted_records(0), records_navigation(block), arena(_arena),
+        sample_counts(nullptr) {
+    init_block();
+    publish();
+  }
+  // a table of a snapshot, its block stays where the mapping put it
+  nghs_ht(const nghs_snapshot::table_record &r, char *base,
+          nghs_arena *_arena)
+      : roommate((key_t)r.roommate), capacity(r.capacity),
+        used_records(r.used_records), deleted_records(r.deleted_records),
+        records_navigation(nullptr), arena(_arena), sample_counts(nullptr) {
+    if (is_small())
+      memcpy(static_cast<void *>(small_records), r.small,
+             sizeof(small_records));
+    else
+      records_navigation = base + r.offset;
+    publish();
+  }
+  // what a block of this table type looks like on disk
+  static nghs_snapshot::layout snapshot_layout() {
+    return {B,
+            Fanout,
+            (uint32_t)sizeof(entry_t),
+            entry_t::max_level,
+            robin_hood ? 1u : swiss ? 2u : 0u,
+            (uint32_t)header_bytes,
+            (uint32_t)sizeof(key_t) * 8};
+  }
+  // a saved table is a single table with a repaired tree
+  void settle() {
+    if (resizing())
+      finish_resize();
+    flush();
+  }
+  size_t snapshot_bytes() { return is_small() ? 0 : block_bytes(capacity); }
+  nghs_snapshot::table_record snapshot_record(uint64_t offset) {
+    nghs_snapshot::table_record r;
+    memset(&r, 0, sizeof(r));
+    r.offset = offset;
+    r.capacity = capacity;
+    r.used_records = used_records;
+    r.deleted_records = deleted_records;
+    r.roommate = roommate;
+    if (is_small())
+      memcpy(r.small, static_cast<void *>(small_records),
+             sizeof(small_records));
+    return r;
+  }
+  // the block pointer and the inline entries share their bytes
+  void swap_storage(nghs_ht &other) {
+    char tmp[sizeof(small_records)];
+    memcpy(tmp, static_cast<void *>(small_records), sizeof(tmp));
+    memcpy(static_cast<void *>(small_records), other.small_records,
+           sizeof(tmp));
+    memcpy(static_cast<void *>(other.small_records), tmp, sizeof(tmp));
   }
 
 public:
-  nghs_ht(index_t _capacity = B)
-      : capacity((std::max(_capacity, (index_t)B) / B + 1) * B),
-        used_records(0), roommate(reserved_key), records_navigation(nullptr) {
-    records_navigation = (char *)malloc(sizeof(entry_t) * capacity +
-                                        sizeof(uint32_t) * get_tree_size());
+  // up to small_capacity expected neighbors start in small mode
+  nghs_ht(index_t _capacity = 0, nghs_arena *_arena = nullptr)
+      : roommate(reserved_key),
+        capacity(small_mode && _capacity <= small_capacity
+                     ? 0
+                     : initial_capacity(_capacity)),
+        used_records(0), deleted_records(0), records_navigation(nullptr),
+        arena(_arena), sample_counts(nullptr) {
+    if (is_small())
+      return;
+    records_navigation = allocate_block(capacity);
     // records = new entry_t[capacity];
-    auto records = get_records();
-    parlay::parallel_for(0, capacity,
-                         [&](auto i) { records[i] = entry_t::empty_entry; });
-    auto navigation_length = get_tree_size();
-    // std::cout << navigation_length << std::endl;
-    // navigation = new uint32_t[navigation_length];
-    auto navigation = get_navigation();
-    memset(navigation, 0, navigation_length * sizeof(uint32_t));
+    init_block();
+    publish();
+  }
+  // a table holding the edges of ins, built in one pass, see rebuild_from
+  template <class T, class = std::enable_if_t<!std::is_integral<T>::value &&
+                                              !std::is_same<T, nghs_ht>::value>>
+  explicit nghs_ht(const T &ins, nghs_arena *_arena = nullptr)
+      : nghs_ht(0, _arena) {
+    rebuild_from(ins);
   }
   ~nghs_ht() {
     // delete[] records;
     // delete[] navigation;
-    free(records_navigation);
+    if (resizing())
+      free_block(get_state()->old_block, get_state()->old_capacity);
+    if (!is_small())
+      free_block(records_navigation, capacity);
+    free_sample_counts(capacity);
   }
   nghs_ht(const nghs_ht &) = delete;
   nghs_ht &operator=(const nghs_ht &) = delete;
-  nghs_ht(nghs_ht &&) = delete;
-  nghs_ht &operator=(nghs_ht &&) = delete;
+  // moving hands over the block, the moved-from table is left empty
+  nghs_ht(nghs_ht &&other) noexcept
+      : nghs_readers<concurrent>(std::move(other)),
+        nghs_counters<nghs_stats_enabled>(other), roommate(other.roommate),
+        capacity(other.capacity),
+        used_records(other.used_records),
+        deleted_records(other.deleted_records), records_navigation(nullptr),
+        arena(other.arena), sample_counts(other.sample_counts) {
+    swap_storage(other);
+    other.sample_counts = nullptr;
+    other.capacity = 0;
+    other.used_records = 0;
+    other.deleted_records = 0;
+    other.roommate = reserved_key;
+  }
+  nghs_ht &operator=(nghs_ht &&other) noexcept {
+    std::swap(roommate, other.roommate);
+    std::swap(capacity, other.capacity);
+    std::swap(used_records, other.used_records);
+    std::swap(deleted_records, other.deleted_records);
+    swap_storage(other);
+    std::swap(arena, other.arena);
+    std::swap(sample_counts, other.sample_counts);
+    this->swap_readers(other);
+    this->swap_counters(other);
+    return *this;
+  }
+
+  // write the table to path as it sits in memory, see nghs_snapshot.h
+  void save(const char *path) {
+    settle();
+    nghs_snapshot::save(
+        path, snapshot_layout(), 1, [&](uint64_t) { return snapshot_bytes(); },
+        [&](uint64_t, uint64_t offset) { return snapshot_record(offset); },
+        [&](uint64_t) { return records_navigation; });
+  }
+  // map a snapshot of one table and use its block in place. The arena
+  // takes over the mapping and hands out the blocks the table grows into
+  // later, so it has to outlive the table
+  static nghs_ht
+  load(const char *path, nghs_arena *_arena,
+       nghs_snapshot::mode m = nghs_snapshot::mode::copy_on_write) {
+    auto mp = nghs_snapshot::map(path, m, snapshot_layout(),
+                                 small_capacity, block_bytes);
+    if (mp.get_header().tables != 1)
+      nghs_snapshot::fail("not a single table snapshot", path);
+    _arena->adopt_mapping(mp.base, mp.bytes);
+    return nghs_ht(mp.records()[0], mp.base, _arena);
+  }
 
   index_t get_size() {
     index_t u = used_records;
     return (roommate == reserved_key) ? u : u + 1; //+1 for roommate
   }
 
+  // replace every edge with those of ins, (vertex, level) pairs with
+  // distinct vertices and at most one level 1 edge. Much faster than
+  // batch_insertion into an empty table: the block is sized for ins once,
+  // entries are placed by home slot with no CAS (see place_sorted) and the
+  // navigation tree is built bottom up in one parallel pass
+  template <class T = parlay::sequence<std::pair<key_t, val_t>>>
+  void rebuild_from(const T &ins) {
+    write_scope w(this);
+    auto ones = parlay::pack_index<size_t>(parlay::delayed_seq<bool>(
+        ins.size(), [&](size_t i) { return ins[i].second == 1; }));
+    auto edges = parlay::filter(
+        parlay::delayed_seq<std::pair<key_t, val_t>>(
+            ins.size(),
+            [&](size_t i) {
+              return std::pair((key_t)ins[i].first, (val_t)ins[i].second);
+            }),
+        [](const std::pair<key_t, val_t> &e) { return e.second != 1; });
+    // the blocks in use go once the new one is published
+    char *old_block = is_small() ? nullptr : records_navigation;
+    index_t old_capacity = capacity;
+    char *drained = resizing() ? get_state()->old_block : nullptr;
+    index_t drained_capacity = drained ? get_state()->old_capacity : 0;
+    bool sampled = sample_counts != nullptr;
+    free_sample_counts(capacity);
+    shared_store(roommate, reserved_key);
+    for (auto i : ones)
+      set_roommate(ins[i].first);
+    deleted_records = 0;
+    if (small_mode && edges.size() <= small_capacity) {
+      capacity = 0;
+      used_records = edges.size();
+      for (index_t i = 0; i < used_records; i++)
+        small_records[i] = entry_t(edges[i].first, edges[i].second);
+    } else {
+      capacity = initial_capacity((index_t)(edges.size() / load_factor));
+      records_navigation = allocate_block(capacity);
+      init_block();
+      {
+        [[maybe_unused]] auto timed = this->time(nghs_phase::probe);
+        place_sorted(edges);
+      }
+      [[maybe_unused]] auto timed = this->time(nghs_phase::repair);
+      build_navigation();
+      // wrapped entries went through insert_slot and marked their path
+      memset(get_dirty(), 0, dirty_words(capacity) * sizeof(uint32_t));
+      if (sampled) {
+        sample_counts = alloc_sample_counts();
+        build_sample_counts();
+      }
+    }
+    publish();
+    if (drained)
+      retire_block(drained, drained_capacity);
+    if (old_block)
+      retire_block(old_block, old_capacity);
+  }
+  // apply_batch over a (vertex, level) batch. Under Robin Hood a level 1
+  // op looks its key up, which must not overlap inserts moving entries, so
+  // those ops run on their own after the rest
+  template <class T, class K, class F>
+  void apply_level1_last(T &batch, K &&key, F &&f) {
+    if constexpr (robin_hood) {
+      auto level1 = [&](size_t i) { return batch[i].second == 1; };
+      apply_batch(batch.size(), key, [&](size_t i) {
+        return level1(i) ? op_delta{0, 0, 0} : f(i);
+      });
+      auto ones = parlay::pack_index<size_t>(
+          parlay::delayed_seq<bool>(batch.size(), level1));
+      apply_batch(ones.size(), [&](size_t j) { return key(ones[j]); },
+                  [&](size_t j) { return f(ones[j]); });
+    } else {
+      apply_batch(batch.size(), key, f);
+    }
+  }
   // batch insertion: sequence of (vertex, level)
   template <class T = parlay::sequence<std::pair<key_t, val_t>>>
   void batch_insertion(T &ins) {
+    write_scope w(this);
+    if (is_small()) {
+      if (used_records + ins.size() <= small_capacity) {
+        for (size_t i = 0; i < ins.size(); i++)
+          small_insert(ins[i].first, ins[i].second);
+        return;
+      }
+      promote(ins.size());
+    }
     ensure_capacity(ins.size());
+    migrate_step(ins.size());
     // std::cout << get_tree_size() << std::endl;
-    used_records += ins.size();
-    parlay::internal::timer t;
-    parlay::parallel_for(0, ins.size(), [&](auto i) {
-      insert(ins[i].first, ins[i].second);
+    auto key = [&](size_t i) { return (key_t)ins[i].first; };
+    apply_level1_last(ins, key, [&](auto i) {
+      return insert(ins[i].first, ins[i].second);
       // assert(find(ins[i].first) == ins[i].second);
     });
-    t.next("pure insertion");
-    update_top_down();
+    repair(ins.size());
   }
   // batch update: sequence of (vertex, level)
   template <class T = parlay::sequence<std::pair<key_t, val_t>>>
   void batch_update(T &upd) {
-    parlay::parallel_for(0, upd.size(), [&](auto i) {
-      update(upd[i].first, upd[i].second);
-      assert(find(upd[i].first) == upd[i].second);
+    write_scope w(this);
+    if (is_small()) {
+      for (size_t i = 0; i < upd.size(); i++)
+        small_update(upd[i].first, upd[i].second);
+      return;
+    }
+    migrate_step(upd.size());
+    auto key = [&](size_t i) { return (key_t)upd[i].first; };
+    apply_level1_last(upd, key, [&](auto i) {
+      // update() aborts on a missing key, no second lookup needed
+      return update(upd[i].first, upd[i].second);
     });
-    update_top_down();
+    repair(upd.size());
   }
   // batch deletion: only need to know the vertex
   template <class T = parlay::sequence<key_t>> void batch_deletion(T &del) {
-    used_records -= del.size();
-    parlay::parallel_for(0, del.size(), [&](auto i) {
-      remove(del[i]);
+    write_scope w(this);
+    if (is_small()) {
+      for (size_t i = 0; i < del.size(); i++)
+        small_remove(del[i]);
+      return;
+    }
+    migrate_step(del.size());
+    auto key = [&](size_t i) { return (key_t)del[i]; };
+    apply_batch(del.size(), key, [&](auto i) {
+      return remove(del[i]);
       // assert(find(del[i]) == 0);
     });
-    update_top_down();
+    repair(del.size());
+    maybe_compact();
   }
+  // mixed batch: sequence of (vertex, level, op), the level of a remove is
+  // ignored. Ops on the same vertex act in batch order, so a vertex ends up
+  // as its ops would leave it one after the other: the last insert, upsert
+  // or remove decides, updates after it change the level it set. The table
+  // is sized once for the inserts and repaired once
+  template <class T = parlay::sequence<std::tuple<key_t, val_t, nghs_op>>>
+  void batch_apply(T &ops) {
+    write_scope w(this);
+    size_t n = ops.size();
+    if (n == 0)
+      return;
+    // reduce every vertex to one op, sorting keeps batch order per vertex
+    auto sorted = parlay::integer_sort(
+        parlay::tabulate(n, [&](size_t i) { return (index_t)i; }),
+        [&](index_t i) { return std::get<0>(ops[i]); });
+    auto starts = parlay::pack_index<size_t>(
+        parlay::delayed_seq<bool>(n, [&](size_t i) {
+          return i == 0 ||
+                 std::get<0>(ops[sorted[i]]) != std::get<0>(ops[sorted[i - 1]]);
+        }));
+    auto net = parlay::tabulate(starts.size(), [&](size_t g) {
+      size_t e = (g + 1 == starts.size()) ? n : starts[g + 1];
+      auto kind = nghs_op::update; // nothing known about the vertex yet
+      val_t level = 0;
+      for (size_t j = starts[g]; j < e; j++) {
+        auto [k, l, op] = ops[sorted[j]];
+        if (op == nghs_op::remove) {
+          kind = op;
+        } else if (op != nghs_op::update) {
+          kind = nghs_op::upsert;
+          level = l;
+        } else if (kind != nghs_op::remove) { // void once removed
+          level = l;
+        }
+      }
+      return std::tuple((key_t)std::get<0>(ops[sorted[starts[g]]]), level,
+                        kind);
+    });
+    // level 1 goes to the roommate and takes no slot
+    size_t inserts = parlay::count_if(net, [](const auto &o) {
+      return std::get<2>(o) == nghs_op::upsert && std::get<1>(o) != 1;
+    });
+    size_t removes = parlay::count_if(
+        net, [](const auto &o) { return std::get<2>(o) == nghs_op::remove; });
+    if (is_small()) {
+      if (used_records + inserts <= small_capacity) {
+        auto small_op = [&](key_t k, val_t l, nghs_op kind) {
+          if (kind == nghs_op::remove) {
+            if (k == roommate)
+              roommate = reserved_key;
+            else
+              small_remove_slot(k, false);
+          } else
+            small_upsert(k, l, kind == nghs_op::upsert);
+        };
+        // the roommate goes first here too
+        key_t r = roommate;
+        for (auto [k, l, kind] : net)
+          if (k == r)
+            small_op(k, l, kind);
+        for (auto [k, l, kind] : net)
+          if (k != r)
+            small_op(k, l, kind);
+        return;
+      }
+      promote(inserts);
+    }
+    ensure_capacity(inserts);
+    migrate_step(net.size());
+    auto op = [&](size_t i) {
+      auto [k, l, kind] = net[i];
+      if (kind == nghs_op::remove)
+        return remove(k, false);
+      return upsert(k, l, kind == nghs_op::upsert);
+    };
+    auto key = [&](size_t i) { return std::get<0>(net[i]); };
+    // the roommate goes first, a level 1 op may take its place
+    key_t r = roommate;
+    size_t first = std::lower_bound(net.begin(), net.end(), r,
+                                    [](const auto &o, key_t k) {
+                                      return std::get<0>(o) < k;
+                                    }) -
+                   net.begin();
+    if (first < net.size() && key(first) == r)
+      apply_batch(1, [&](size_t) { return r; },
+                  [&](size_t) { return op(first); });
+    if constexpr (robin_hood) {
+      // inserts displace entries, nothing may locate a key while they run:
+      // level 1 ops first, then the ops on present keys, then the inserts
+      auto level1 = [&](size_t i) {
+        auto [k, l, kind] = net[i];
+        return k != r && kind != nghs_op::remove && l == 1;
+      };
+      auto ones = parlay::pack_index<size_t>(
+          parlay::delayed_seq<bool>(net.size(), level1));
+      apply_batch(ones.size(), [&](size_t j) { return key(ones[j]); },
+                  [&](size_t j) { return op(ones[j]); });
+      parlay::sequence<bool> missing(net.size(), false);
+      apply_batch(net.size(), key, [&](size_t i) {
+        auto [k, l, kind] = net[i];
+        if (k == r || level1(i))
+          return op_delta{0, 0, 0};
+        if (kind == nghs_op::remove)
+          return remove(k, false);
+        auto d = upsert(k, l, false);
+        missing[i] = kind == nghs_op::upsert && d.old_level == 0;
+        return d;
+      });
+      auto adds = parlay::pack_index<size_t>(missing);
+      apply_batch(adds.size(), [&](size_t j) { return key(adds[j]); },
+                  [&](size_t j) {
+                    val_t l = std::get<1>(net[adds[j]]);
+                    return op_delta{insert_slot(key(adds[j]), l), 0, l};
+                  });
+    } else {
+      apply_batch(net.size(), key, [&](size_t i) {
+        return key(i) == r ? op_delta{0, 0, 0} : op(i);
+      });
+    }
+    repair(net.size());
+    if (removes)
+      maybe_compact();
+  }
+  // levels of the keys in K, 0 for a missing key. Lookups run in windows
+  // that prefetch their home slots ahead; with sort_by_home they also run
+  // in slot order so nearby probes share cache lines, results keep the
+  // order of K either way
   template <class T = parlay::sequence<key_t>>
-  parlay::sequence<val_t> batch_find(T &K) {
-    return parlay::map(K, [&](auto x) { return find(x); });
+  parlay::sequence<val_t> batch_find(T &K, bool sort_by_home = false) {
+    nghs_epoch::guard g(concurrent);
+    return read_current([&](const view &t) {
+      auto res = parlay::sequence<val_t>::uninitialized(K.size());
+      if (!sort_by_home || t.cap == 0) {
+        for_batch_prefetched(
+            t, K.size(), [&](size_t i) { return (key_t)K[i]; },
+            [&](size_t i) { res[i] = find_in(t, K[i]); });
+        return res;
+      }
+      auto order = parlay::integer_sort(
+          parlay::tabulate(K.size(),
+                           [&](size_t i) {
+                             return std::pair(
+                                 (index_t)(hash_key(K[i]) % t.cap), (index_t)i);
+                           }),
+          [](const auto &p) { return p.first; });
+      for_batch_prefetched(
+          t, order.size(), [&](size_t j) { return (key_t)K[order[j].second]; },
+          [&](size_t j) {
+            index_t i = order[j].second;
+            res[i] = find_in(t, K[i]);
+          });
+      return res;
+    });
   }
   // fetch k level l edges
-  parlay::sequence<key_t> fetch(key_t k, val_t l) {
+  parlay::sequence<key_t> fetch(index_t k, val_t l) {
+    [[maybe_unused]] auto timed = this->time(nghs_phase::fetch);
+    flush();
+    nghs_epoch::guard g(concurrent);
+    return read_current([&](const view &t) {
+      parlay::sequence<key_t> nghs;
+      key_t r = shared_load(roommate);
+      index_t c = l > 1 && t.cap ? level_count(t.block, l) : 0;
+      if (l == 1 && r != reserved_key)
+        nghs.push_back(r);
+      else if (l > 1 && t.cap == 0) {
+        for (index_t i = 0; i < used_records && nghs.size() < k; i++)
+          if (small_records[i].level() == l)
+            nghs.push_back(small_records[i].key());
+      } else if (c) {
+        // if k > number of all level l edges, fetch all
+        // store result in sequence, allocate exactly what we will find
+        index_t want = std::min(k, c);
+        // an entry on the move may show up in both tables, leave room for it
+        bool dups = concurrent && incremental && old_block_of(t.block);
+        nghs = parlay::sequence<key_t>(dups ? 2 * want : want);
+        // use atomic variable to see how many edges we still need to fetch
+        std::atomic<index_t> fetched = 0;
+        // the old table first, same as find()
+        auto keys = [&](const entry_t *block, key_t *found) {
+          return scan_keys(block, l, found);
+        };
+        bool old = fetch_old(t, nghs, get_bit_val(l), keys, fetched);
+        fetch_top_down(t, nghs, get_bit_val(l), keys, fetched);
+        if (fetched < nghs.size())
+          nghs.resize(fetched);
+        if (dups && old) {
+          nghs = parlay::remove_duplicates_ordered(nghs, std::less<key_t>());
+          if (nghs.size() > want)
+            nghs.resize(want);
+        }
+      }
+      // parlay::parallel_for(0, nghs.size(),
+      //                      [&](auto i) { assert(find(nghs[i]) == l); });
+      return nghs;
+    });
+  }
+  // k uniformly random level l edges, distinct unless with_replacement.
+  // The first call builds per-level counts over the navigation tree, about
+  // 128 bytes more per internal node from then on; after that every edge
+  // costs one descent, O(log(capacity / B) + B)
+  parlay::sequence<key_t> sample(index_t k, val_t l, uint64_t seed,
+                                 bool with_replacement = false) {
+    if (resizing()) { // select() walks the new tree only
+      write_scope w(this);
+      finish_resize();
+    }
+    flush();
     parlay::sequence<key_t> nghs;
-    if (l == 1 && roommate != reserved_key)
-      nghs.push_back(roommate);
-    else {
-      // if k > number of all level l edges, fetch all
-      // store result in sequence, allocate space in advance
-      nghs = parlay::sequence<key_t>(k);
-      // use atomic variable to see how many edges we still need to fetch
-      std::atomic<uint32_t> fetched = 0;
-      fetch_top_down(nghs, l, fetched);
-      if (fetched < nghs.size())
-        nghs.resize(fetched);
-    }
-    // parlay::parallel_for(0, nghs.size(),
-    //                      [&](auto i) { assert(find(nghs[i]) == l); });
+    index_t c = count(l);
+    if (c == 0 || k == 0)
+      return nghs;
+    if (l == 1)
+      return parlay::sequence<key_t>(with_replacement ? k : 1, roommate);
+    if (sample_counts == nullptr && !is_small()) {
+      write_scope w(this);
+      sample_counts = alloc_sample_counts();
+      build_sample_counts();
+    }
+    auto draw = [&](size_t i) {
+      return (index_t)(parlay::hash64(seed * 0x9e3779b97f4a7c15ull + i) % c);
+    };
+    parlay::sequence<index_t> ranks;
+    if (with_replacement)
+      ranks = parlay::tabulate(k, draw);
+    else if ((size_t)k * 2 >= c) {
+      // most of the level is wanted: order all ranks randomly, keep k
+      auto keyed = parlay::tabulate(c, [&](index_t r) {
+        return std::pair(parlay::hash64(seed * 0x9e3779b97f4a7c15ull + r), r);
+      });
+      keyed = parlay::sort(keyed);
+      ranks = parlay::tabulate(std::min(k, c),
+                               [&](size_t i) { return keyed[i].second; });
+    } else {
+      // first k distinct values of an iid draw sequence form a uniform
+      // k-subset, draw until that many distinct ranks came up
+      for (size_t m = 2 * (size_t)k;; m *= 2) {
+        auto draws = parlay::sort(parlay::tabulate(
+            m, [&](size_t i) { return std::pair(draw(i), i); }));
+        auto first = parlay::filter(
+            parlay::tabulate(m, [&](size_t i) { return i; }), [&](size_t i) {
+              return i == 0 || draws[i].first != draws[i - 1].first;
+            });
+        if (first.size() < k)
+          continue;
+        auto order = parlay::sort(parlay::map(first, [&](size_t i) {
+          return std::pair(draws[i].second, draws[i].first);
+        }));
+        ranks = parlay::tabulate(k, [&](size_t i) { return order[i].second; });
+        break;
+      }
+    }
+    return parlay::map(ranks, [&](index_t r) { return select(l, r); });
+  }
+  // the first k level l edges in slot order, the same result on every run.
+  // Leaves are taken in rounds of doubling size, every round counts matches
+  // per leaf and places them with a prefix sum, no shared counter involved
+  parlay::sequence<key_t> fetch_ordered(index_t k, val_t l) {
+    [[maybe_unused]] auto timed = this->time(nghs_phase::fetch);
+    if (l == 1 || is_small()) // small mode fetches in entry order already
+      return fetch(k, l);
+    if (resizing()) // slot order is only defined for one table
+      finish_resize();
+    flush();
+    index_t target = std::min(k, count(l));
+    parlay::sequence<key_t> nghs(target);
+    size_t done = 0, found = 0;
+    // every leaf found holds at least one match
+    for (size_t m = std::max((size_t)1, (size_t)target / B);
+         found < target; m *= 2) {
+      parlay::sequence<index_t> leaves;
+      collect_leaves(leaves, l, m);
+      auto matches = parlay::tabulate(leaves.size() - done, [&](size_t j) {
+        key_t keys[B + 4];
+        return block_keys(leaves[done + j], l, keys);
+      });
+      auto offsets = parlay::scan(matches);
+      parlay::parallel_for(0, matches.size(), [&](size_t j) {
+        key_t keys[B + 4];
+        index_t c = block_keys(leaves[done + j], l, keys);
+        size_t o = found + offsets.first[j];
+        for (index_t x = 0; x < c && o + x < target; x++)
+          nghs[o + x] = keys[x];
+      });
+      found += offsets.second;
+      if (leaves.size() < m) // ran out of leaves
+        break;
+      done = leaves.size();
+    }
+    assert(found >= target);
+    return nghs;
+  }
+  // fetch up to k level `from` edges and move them to level `to`, same as
+  // fetch(k, from) followed by batch_update but in a single tree walk.
+  // Level 1 holds a single edge: to == 1 moves one edge at most, and none
+  // while another edge is at level 1
+  parlay::sequence<key_t> fetch_and_set_level(index_t k, val_t from,
+                                              val_t to) {
+    if (from == to)
+      return fetch(k, from);
+    if (from == 1 || to == 1) { // the roommate lives outside the table
+      if (to == 1 && roommate != reserved_key)
+        return {};
+      auto nghs = fetch(to == 1 ? std::min<index_t>(k, 1) : k, from);
+      // upsert, an update leaves the roommate's level alone
+      auto ops = parlay::map(
+          nghs, [&](key_t v) { return std::tuple(v, to, nghs_op::upsert); });
+      batch_apply(ops);
+      return nghs;
+    }
+    assert(to <= entry_t::max_level);
+    write_scope w(this);
+    if (is_small()) {
+      parlay::sequence<key_t> nghs;
+      for (index_t i = 0; i < used_records && nghs.size() < k; i++)
+        if (small_records[i].level() == from) {
+          nghs.push_back(small_records[i].key());
+          small_records[i].set_level(to);
+        }
+      return nghs;
+    }
+    if (resizing())
+      finish_resize();
+    flush();
+    parlay::sequence<key_t> nghs(std::min(k, count(from)));
+    if (nghs.size() == 0)
+      return nghs;
+    std::atomic<index_t> fetched = 0;
+    relevel_top_down(nghs, from, to, fetched);
+    auto counts = get_level_counts();
+    shared_store(counts[from - 1], (index_t)(counts[from - 1] - nghs.size()));
+    shared_store(counts[to - 1], (index_t)(counts[to - 1] + nghs.size()));
     return nghs;
   }
   // debug export alive neighbors and their levels
   parlay::sequence<std::pair<key_t, val_t>> to_sequence_sorted() {
-    auto records = get_records();
+    // small mode keeps its entries dense in front of the inline slots
+    auto records = is_small() ? small_records : get_records();
     parlay::sequence<std::pair<key_t, val_t>> alive;
     if (roommate != reserved_key)
       alive.emplace_back(std::pair(roommate, 1));
-    for (index_t i = 0; i < capacity; i++) {
-      if (records[i] != entry_t::empty_entry &&
-          records[i] != entry_t::deleted_entry)
-        alive.emplace_back(std::pair(records[i].k, records[i].v));
+    for (index_t i = 0; i < (is_small() ? used_records : capacity); i++) {
+      if (records[i] != empty_entry &&
+          records[i] != deleted_entry)
+        alive.emplace_back(std::pair(records[i].key(), records[i].level()));
+    }
+    if (resizing()) {
+      auto rs = get_state();
+      auto old_records = records_of(rs->old_block);
+      for (index_t i = (index_t)rs->cursor * B; i < rs->old_capacity; i++)
+        if (old_records[i] != empty_entry && old_records[i] != deleted_entry)
+          alive.emplace_back(
+              std::pair(old_records[i].key(), old_records[i].level()));
     }
     return parlay::remove_duplicates_ordered(
         alive,
@@ -418,65 +2298,278 @@ public:
   }
   // debug
   // debug check correctness for complete binary tree
-  void print_tree_path(key_t k) {
+  void print_tree_path(key_t k, std::ostream &out = std::cerr) {
+    if (is_small()) {
+      out << "small mode, " << used_records << " inline entries"
+                << std::endl;
+      return;
+    }
     auto records = get_records();
     auto navigation = get_navigation();
-    std::cout << "hash table capacity " << capacity << std::endl;
+    out << "hash table capacity " << capacity << std::endl;
     index_t i = firstIndex(k);
-    std::cout << "first index " << i << std::endl;
+    out << "first index " << i << std::endl;
     index_t st = i;
-    while (records[i] != entry_t::empty_entry) {
-      if (records[i].k == k)
+    while (records[i] != empty_entry) {
+      if (records[i].key() == k)
         break;
       i = incrementIndex(i);
-      std::cout << "next index " << i << std::endl;
+      out << "next index " << i << std::endl;
       if (i == st)
         break;
     }
-    std::cout << "tree size " << get_tree_size() << std::endl;
-    std::cout << "internal node size " << get_internal_node_size() << std::endl;
-    std::cout << "leaf size " << get_leaf_size() << std::endl;
-    std::cout << "tree index " << get_tree_index(i) << std::endl;
-    auto x = get_tree_index(i) - get_internal_node_size();
-    std::cout << "id of block " << x << std::endl;
+    out << "tree size " << get_tree_size() << std::endl;
+    out << "internal node size " << get_internal_node_size() << std::endl;
+    out << "leaf size " << get_leaf_size() << std::endl;
+    out << "tree index " << get_tree_index(i) << std::endl;
+    auto x = get_leaf_start(get_tree_index(i)) / B;
+    out << "id of block " << x << std::endl;
     uint32_t v = 0;
     for (auto i = x * B; i < x * B + B; i++) {
-      std::cout << records[i].k << " " << records[i].v << std::endl;
-      v |= get_bit_val(records[i].v);
+      out << records[i].key() << " " << records[i].level() << std::endl;
+      v |= get_bit_val(records[i].level());
     }
-    std::cout << "augmented value of this block " << std::bitset<32>(v)
+    out << "augmented value of this block " << std::bitset<32>(v)
               << std::endl;
     x = get_tree_index(i);
     do {
-      std::cout << x << " " << std::bitset<32>(navigation[x]) << std::endl;
-      x = (x - 1) / 2;
+      out << x << " " << std::bitset<32>(navigation[x]) << std::endl;
+      x = get_parent(x);
     } while (x);
   }
   // print hash table layout
-  void display() const {
+  void display(std::ostream &out = std::cerr) const {
     auto records = get_records();
-    std::cout << "\n--- Hash record Contents (Size: " << used_records
+    out << "\n--- Hash record Contents (Size: " << used_records
               << " Capacity: " << capacity << ") ---" << std::endl;
     if (roommate != reserved_key)
-      std::cout << "OCCUPIED (Key: " << roommate << ", Value: \"" << 1 << "\")";
+      out << "OCCUPIED (Key: " << roommate << ", Value: \"" << 1 << "\")";
     for (index_t i = 0; i < capacity; ++i) {
-      std::cout << "[" << i << "]: ";
-      if (records[i] != entry_t::empty_entry) {
-        if (records[i] != entry_t::deleted_entry)
-          std::cout << "OCCUPIED (Key: " << records[i].k << ", Value: \""
-                    << records[i].v << "\")";
+      out << "[" << i << "]: ";
+      if (records[i] != empty_entry) {
+        if (records[i] != deleted_entry)
+          out << "OCCUPIED (Key: " << records[i].key() << ", Value: \""
+                    << records[i].level() << "\")";
         else
-          std::cout << "DELETED";
+          out << "DELETED";
       } else {
-        std::cout << "empty_key";
+        out << "empty_key";
       }
-      std::cout << std::endl;
+      out << std::endl;
     }
-    std::cout << "------------------------------------------" << std::endl;
+    out << "------------------------------------------" << std::endl;
   }
   size_t get_space_usage() {
-    return sizeof(nghs_ht) + sizeof(entry_t) * capacity +
-           sizeof(uint32_t) * get_tree_size();
+    if (is_small())
+      return sizeof(nghs_ht);
+    return sizeof(nghs_ht) + block_bytes(capacity) +
+           (resizing() ? block_bytes(get_state()->old_capacity) : 0) +
+           sample_bytes();
+  }
+  // the per-node level counts sample() keeps next to the block
+  size_t sample_bytes() {
+    return sample_counts ? sample_counts_bytes(capacity) : 0;
+  }
+  // see nghs_stats.h. The probe lengths come from a scan of the table,
+  // entries still waiting in the old table of a resize are left out
+  nghs_stats stats() {
+    nghs_stats s;
+    s.size = get_size();
+    s.capacity = capacity;
+    s.tombstones = deleted_records;
+    s.tombstone_ratio = capacity ? (double)deleted_records / capacity : 0;
+    if (!is_small()) {
+      // the buckets, then the sum and the maximum of the distances
+      constexpr uint32_t nb = nghs_stats::probe_buckets;
+      using histogram = std::array<uint64_t, nb + 2>;
+      auto records = get_records();
+      size_t chunks = std::min<size_t>(capacity / B, 1024);
+      auto partial = parlay::tabulate(chunks, [&](size_t c) {
+        histogram h{};
+        size_t e = (c + 1) * capacity / chunks;
+        for (size_t i = c * capacity / chunks; i < e; i++) {
+          if (records[i] == empty_entry || records[i] == deleted_entry)
+            continue;
+          index_t d = probe_distance(firstIndex(records[i].key()), i);
+          uint32_t b = d ? 64 - __builtin_clzll(d) : 0;
+          h[std::min(b, nb - 1)]++;
+          h[nb] += d;
+          h[nb + 1] = std::max<uint64_t>(h[nb + 1], d);
+        }
+        return h;
+      });
+      uint64_t total = 0, live = 0;
+      for (auto &h : partial) {
+        for (uint32_t b = 0; b < nb; b++) {
+          s.probe_histogram[b] += h[b];
+          live += h[b];
+        }
+        total += h[nb];
+        s.max_probe = std::max(s.max_probe, h[nb + 1]);
+      }
+      s.mean_probe = live ? (double)total / live : 0;
+    }
+    this->fill_stats(s);
+    return s;
+  }
+  // zero the counters of stats()
+  void reset_stats() { nghs_counters<nghs_stats_enabled>::reset_stats(); }
+  // number of level l edges
+  index_t count(val_t l) {
+    assert(l > 0 && l < 33);
+    if (l == 1)
+      return shared_load(roommate) != reserved_key;
+    nghs_epoch::guard g(concurrent);
+    view t = reader_view();
+    if (t.cap == 0) {
+      index_t c = 0;
+      for (index_t i = 0; i < used_records; i++)
+        c += small_records[i].level() == l;
+      return c;
+    }
+    return level_count(t.block, l);
+  }
+  // bit l - 1 set when there is a level l edge, bit 0 being the roommate.
+  // The root of the navigation tree holds the rest, during an incremental
+  // resize the level counters do as the old tree may still claim levels
+  // its moved entries took along
+  uint32_t level_mask() {
+    flush();
+    uint32_t m = shared_load(roommate) != reserved_key;
+    nghs_epoch::guard g(concurrent);
+    view t = reader_view();
+    if (t.cap == 0) {
+      for (index_t i = 0; i < used_records; i++)
+        m |= get_bit_val(small_records[i].level());
+      return m;
+    }
+    if constexpr (incremental) {
+      if (old_block_of(t.block)) {
+        for (val_t l = 2; l < 33; l++)
+          m |= level_count(t.block, l) ? get_bit_val(l) : 0;
+        return m;
+      }
+    }
+    return m | navigation_of(t.block, t.cap)[0];
+  }
+  // lowest and highest level with an edge, 0 when there is none
+  val_t min_level() {
+    uint32_t m = level_mask();
+    return m ? __builtin_ctz(m) + 1 : 0;
+  }
+  val_t max_level() {
+    uint32_t m = level_mask();
+    return m ? 32 - __builtin_clz(m) : 0;
+  }
+  bool has_level(val_t l) {
+    assert(l > 0 && l < 33);
+    return level_mask() >> (l - 1) & 1;
+  }
+  // up to k edges with a level in [lo, hi] as (key, level) pairs, one
+  // descent into the subtrees whose mask meets the range
+  parlay::sequence<std::pair<key_t, val_t>> fetch_range(index_t k, val_t lo,
+                                                        val_t hi) {
+    [[maybe_unused]] auto timed = this->time(nghs_phase::fetch);
+    assert(lo > 0 && hi < 33);
+    using kv = std::pair<key_t, val_t>;
+    parlay::sequence<kv> out;
+    if (k == 0 || lo > hi)
+      return out;
+    key_t r = shared_load(roommate);
+    if (lo == 1 && r != reserved_key)
+      out.push_back(kv(r, 1));
+    lo = std::max(lo, (val_t)2);
+    if (lo > hi)
+      return out;
+    uint32_t bits = (hi == 32 ? ~(uint32_t)0 : ((uint32_t)1 << hi) - 1) &
+                    ~(((uint32_t)1 << (lo - 1)) - 1);
+    flush();
+    nghs_epoch::guard g(concurrent);
+    return read_current([&](const view &t) {
+      auto res = out;
+      if (t.cap == 0) {
+        for (index_t i = 0; i < used_records && res.size() < k; i++)
+          if (get_bit_val(small_records[i].level()) & bits)
+            res.push_back(
+                kv(small_records[i].key(), small_records[i].level()));
+        return res;
+      }
+      index_t total = 0;
+      for (val_t l = lo; l <= hi; l++)
+        total += level_count(t.block, l);
+      index_t want = std::min<index_t>(k - res.size(), total);
+      if (want == 0)
+        return res;
+      // an entry on the move may show up in both tables, leave room for it
+      bool dups = concurrent && incremental && old_block_of(t.block);
+      parlay::sequence<kv> found(dups ? 2 * want : want);
+      std::atomic<index_t> fetched = 0;
+      auto pairs = [&](const entry_t *block, kv *o) {
+        index_t c = 0;
+        for (index_t i = 0; i < B; i++) {
+          entry_t e = load_entry(const_cast<entry_t *>(block) + i);
+          if (get_bit_val(e.level()) & bits)
+            o[c++] = kv(e.key(), e.level());
+        }
+        return c;
+      };
+      bool old = fetch_old(t, found, bits, pairs, fetched);
+      fetch_top_down(t, found, bits, pairs, fetched);
+      if (fetched < found.size())
+        found.resize(fetched);
+      if (dups && old) {
+        found = parlay::remove_duplicates_ordered(
+            found, [](const kv &a, const kv &b) { return a.first < b.first; });
+        if (found.size() > want)
+          found.resize(want);
+      }
+      res.append(found);
+      return res;
+    });
+  }
+  // [l] holds the number of level l edges, [0] is unused
+  parlay::sequence<index_t> level_histogram() {
+    return parlay::tabulate(33, [&](val_t l) { return l ? count(l) : 0; });
+  }
+  index_t get_capacity() const {
+    return is_small() ? small_capacity : capacity;
+  }
+  index_t get_tombstones() const { return deleted_records; }
+  // with concurrent_readers: odd while a batch runs, a reader that reads
+  // the same even value before and after its queries saw no batch
+  uint64_t version() const {
+    if constexpr (concurrent)
+      return this->batch_seq.load();
+    else
+      return 0;
+  }
+  // repair what lazy_repair batches left marked, queries that read the
+  // tree do so by themselves. Nothing to do with eager_repair
+  void flush() {
+    if constexpr (lazy) {
+      if (is_small() || !is_dirty(0))
+        return;
+      [[maybe_unused]] auto timed = this->time(nghs_phase::repair);
+      update_top_down(0, capacity >= seq_threshold);
+    }
+  }
+  // rehash in place, dropping every tombstone
+  void compact() {
+    write_scope w(this);
+    if (deleted_records)
+      rehash(capacity);
+  }
+  // rehash into the smallest table that holds the live entries, or move
+  // them inline if they fit
+  void shrink_to_fit() {
+    write_scope w(this);
+    if (is_small())
+      return;
+    if (small_mode && used_records <= small_capacity)
+      return demote();
+    auto target = initial_capacity(used_records / load_factor);
+    if (target < capacity || deleted_records)
+      rehash(std::min(target, capacity));
   }
 };
 #endif
\ No newline at end of file
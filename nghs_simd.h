@@ -0,0 +1,253 @@
+#ifndef NEIGHBOR_HASH_SIMD
+#define NEIGHBOR_HASH_SIMD
+#include <cstdint>
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
+// Kernels over runs of navigation masks and over leaf blocks. The instruction
+// set is picked at compile time (-mavx2, -mavx512f, -mavx512bw), anything
+// else takes SSE2 or the scalar loop. Bit j of a result stands for element j.
+namespace nghs_simd {
+
+// bit j set when masks[j] shares a bit with bits
+template <uint32_t N>
+inline uint32_t masks_any(const uint32_t *masks, uint32_t bits) {
+#if defined(__AVX512F__)
+  if constexpr (N == 16)
+    return _mm512_test_epi32_mask(_mm512_loadu_si512(masks),
+                                  _mm512_set1_epi32((int)bits));
+#endif
+#if defined(__AVX2__)
+  if constexpr (N % 8 == 0) {
+    uint32_t hits = 0;
+    const __m256i b = _mm256_set1_epi32((int)bits);
+    for (uint32_t j = 0; j < N; j += 8) {
+      __m256i m = _mm256_and_si256(
+          _mm256_loadu_si256((const __m256i *)(masks + j)), b);
+      __m256i z = _mm256_cmpeq_epi32(m, _mm256_setzero_si256());
+      hits |= (~(uint32_t)_mm256_movemask_ps(_mm256_castsi256_ps(z)) & 0xff)
+              << j;
+    }
+    return hits;
+  }
+#endif
+  uint32_t hits = 0;
+  for (uint32_t j = 0; j < N; j++)
+    hits |= (uint32_t)((masks[j] & bits) != 0) << j;
+  return hits;
+}
+
+// bit j set when masks[j] == val
+template <uint32_t N>
+inline uint32_t masks_equal(const uint32_t *masks, uint32_t val) {
+#if defined(__AVX512F__)
+  if constexpr (N == 16)
+    return _mm512_cmpeq_epi32_mask(_mm512_loadu_si512(masks),
+                                   _mm512_set1_epi32((int)val));
+#endif
+#if defined(__AVX2__)
+  if constexpr (N % 8 == 0) {
+    uint32_t hits = 0;
+    const __m256i v = _mm256_set1_epi32((int)val);
+    for (uint32_t j = 0; j < N; j += 8) {
+      __m256i e = _mm256_cmpeq_epi32(
+          _mm256_loadu_si256((const __m256i *)(masks + j)), v);
+      hits |= (uint32_t)_mm256_movemask_ps(_mm256_castsi256_ps(e)) << j;
+    }
+    return hits;
+  }
+#endif
+  uint32_t hits = 0;
+  for (uint32_t j = 0; j < N; j++)
+    hits |= (uint32_t)(masks[j] == val) << j;
+  return hits;
+}
+
+// union of N masks
+template <uint32_t N> inline uint32_t masks_or(const uint32_t *masks) {
+  uint32_t m = 0;
+  for (uint32_t j = 0; j < N; j++) // fixed trip count, vectorizes
+    m |= masks[j];
+  return m;
+}
+
+// Leaf blocks: N entries of interleaved (key, level) pairs
+
+// union of 1 << (level - 1) over the levels above 1, level 0 (empty) and
+// 1 (deleted) add nothing
+template <uint32_t N> inline uint32_t block_level_mask(const uint32_t *kv) {
+  uint32_t m = 0;
+  uint32_t j = 0;
+#if defined(__AVX512F__)
+  if constexpr (N >= 8) {
+    // sllv shifts by 2^32 - 1 to 0, so level 0 drops out by itself
+    const __m512i one = _mm512_set1_epi32(1);
+    __m512i acc = _mm512_setzero_si512();
+    for (; j + 8 <= N; j += 8) {
+      __m512i x = _mm512_loadu_si512(kv + 2 * j);
+      acc = _mm512_or_si512(
+          acc, _mm512_maskz_sllv_epi32(0xaaaa, one, _mm512_sub_epi32(x, one)));
+    }
+    // GCC 12's _mm512_reduce_or_epi32 warns about an uninitialized
+    // register in its own header, the lanes are few enough to OR by hand
+    alignas(64) uint32_t lanes[16];
+    _mm512_store_si512(lanes, acc);
+    for (uint32_t i = 1; i < 16; i += 2) // only the level lanes are set
+      m |= lanes[i];
+  }
+#elif defined(__AVX2__)
+  if constexpr (N >= 4) {
+    const __m256i one = _mm256_set1_epi32(1);
+    const __m256i odd = _mm256_setr_epi32(0, -1, 0, -1, 0, -1, 0, -1);
+    __m256i acc = _mm256_setzero_si256();
+    for (; j + 4 <= N; j += 4) {
+      __m256i x = _mm256_loadu_si256((const __m256i *)(kv + 2 * j));
+      acc = _mm256_or_si256(
+          acc, _mm256_and_si256(
+                   _mm256_sllv_epi32(one, _mm256_sub_epi32(x, one)), odd));
+    }
+    __m128i h = _mm_or_si128(_mm256_castsi256_si128(acc),
+                             _mm256_extracti128_si256(acc, 1));
+    h = _mm_or_si128(h, _mm_unpackhi_epi64(h, h));
+    m = (uint32_t)_mm_extract_epi32(h, 1) | (uint32_t)_mm_cvtsi128_si32(h);
+  }
+#endif
+  for (; j < N; j++) {
+    uint32_t l = kv[2 * j + 1];
+    m |= l ? (uint32_t)1 << (l - 1) : 0;
+  }
+  return m & ~(uint32_t)1;
+}
+
+#if defined(__AVX2__) && !defined(__AVX512F__)
+// lane order that packs the keys of the picked entries of a 4-entry group
+// to the front, indexed by the 4-bit pick mask
+struct compress_table {
+  uint32_t lanes[16][8];
+  constexpr compress_table() : lanes() {
+    for (uint32_t m = 0; m < 16; m++) {
+      uint32_t c = 0;
+      for (uint32_t e = 0; e < 4; e++)
+        if (m >> e & 1)
+          lanes[m][c++] = 2 * e;
+    }
+  }
+};
+inline constexpr compress_table compress_lanes{};
+#endif
+
+// write the keys of the entries at `level` to out in slot order and return
+// how many, out needs room for N + 4 keys as vector stores may run past
+template <uint32_t N>
+inline uint32_t block_match(const uint32_t *kv, uint32_t level,
+                            uint32_t *out) {
+  uint32_t c = 0;
+  uint32_t j = 0;
+#if defined(__AVX512F__)
+  if constexpr (N >= 8) {
+    const __m512i l = _mm512_set1_epi32((int)level);
+    for (; j + 8 <= N; j += 8) {
+      __m512i x = _mm512_loadu_si512(kv + 2 * j);
+      // a hit on the level lane picks the key lane right before it
+      __mmask16 hit = _mm512_mask_cmpeq_epi32_mask(0xaaaa, x, l);
+      _mm512_mask_compressstoreu_epi32(out + c, (__mmask16)(hit >> 1), x);
+      c += __builtin_popcount(hit);
+    }
+  }
+#elif defined(__AVX2__)
+  if constexpr (N >= 4) {
+    const __m256i l = _mm256_set1_epi32((int)level);
+    for (; j + 4 <= N; j += 4) {
+      __m256i x = _mm256_loadu_si256((const __m256i *)(kv + 2 * j));
+      uint32_t bits = (uint32_t)_mm256_movemask_ps(
+          _mm256_castsi256_ps(_mm256_cmpeq_epi32(x, l)));
+      uint32_t hit = (bits >> 1 & 1) | (bits >> 2 & 2) | (bits >> 3 & 4) |
+                     (bits >> 4 & 8);
+      __m256i p = _mm256_permutevar8x32_epi32(
+          x, _mm256_loadu_si256(
+                 (const __m256i *)compress_lanes.lanes[hit]));
+      _mm_storeu_si128((__m128i *)(out + c), _mm256_castsi256_si128(p));
+      c += __builtin_popcount(hit);
+    }
+  }
+#endif
+  for (; j < N; j++)
+    if (kv[2 * j + 1] == level)
+      out[c++] = kv[2 * j];
+  return c;
+}
+
+// Control bytes, N up to 64
+
+// bit j set when bytes[j] == b
+template <uint32_t N>
+inline uint64_t bytes_equal(const uint8_t *bytes, uint8_t b) {
+  static_assert(N <= 64);
+#if defined(__AVX512BW__)
+  if constexpr (N == 64)
+    return _mm512_cmpeq_epi8_mask(_mm512_loadu_si512(bytes),
+                                  _mm512_set1_epi8((char)b));
+#endif
+#if defined(__AVX2__)
+  if constexpr (N % 32 == 0) {
+    uint64_t hits = 0;
+    const __m256i v = _mm256_set1_epi8((char)b);
+    for (uint32_t j = 0; j < N; j += 32)
+      hits |= (uint64_t)(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(
+                  _mm256_loadu_si256((const __m256i *)(bytes + j)), v))
+              << j;
+    return hits;
+  }
+#endif
+#if defined(__SSE2__)
+  if constexpr (N % 16 == 0) {
+    uint64_t hits = 0;
+    const __m128i v = _mm_set1_epi8((char)b);
+    for (uint32_t j = 0; j < N; j += 16)
+      hits |= (uint64_t)(uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(
+                  _mm_loadu_si128((const __m128i *)(bytes + j)), v))
+              << j;
+    return hits;
+  }
+#endif
+  uint64_t hits = 0;
+  for (uint32_t j = 0; j < N; j++)
+    hits |= (uint64_t)(bytes[j] == b) << j;
+  return hits;
+}
+
+// bit j set when the top bit of bytes[j] is set
+template <uint32_t N> inline uint64_t bytes_high(const uint8_t *bytes) {
+  static_assert(N <= 64);
+#if defined(__AVX512BW__)
+  if constexpr (N == 64)
+    return _mm512_movepi8_mask(_mm512_loadu_si512(bytes));
+#endif
+#if defined(__AVX2__)
+  if constexpr (N % 32 == 0) {
+    uint64_t hits = 0;
+    for (uint32_t j = 0; j < N; j += 32)
+      hits |= (uint64_t)(uint32_t)_mm256_movemask_epi8(
+                  _mm256_loadu_si256((const __m256i *)(bytes + j)))
+              << j;
+    return hits;
+  }
+#endif
+#if defined(__SSE2__)
+  if constexpr (N % 16 == 0) {
+    uint64_t hits = 0;
+    for (uint32_t j = 0; j < N; j += 16)
+      hits |= (uint64_t)(uint32_t)_mm_movemask_epi8(
+                  _mm_loadu_si128((const __m128i *)(bytes + j)))
+              << j;
+    return hits;
+  }
+#endif
+  uint64_t hits = 0;
+  for (uint32_t j = 0; j < N; j++)
+    hits |= (uint64_t)(bytes[j] >> 7) << j;
+  return hits;
+}
+
+} // namespace nghs_simd
+#endif
@@ -0,0 +1,184 @@
+#ifndef NEIGHBOR_HASH_SNAPSHOT
+#define NEIGHBOR_HASH_SNAPSHOT
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <iostream>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+// On-disk snapshots of one table or a whole graph. Blocks are written as
+// they sit in memory, so loading maps the file and points the tables at
+// it, with no rehashing and no tree rebuild:
+//   [header, one page][a record per table, padded to a page]
+//   [blocks, each on a 64-byte boundary]
+// A snapshot only loads into a table type with the same layout.
+namespace nghs_snapshot {
+
+constexpr char magic[8] = {'N', 'G', 'H', 'S', 'S', 'N', 'A', 'P'};
+constexpr uint32_t version = 1;
+constexpr size_t page = 4096;
+
+enum class mode {
+  read_only,     // shared and read-only, queries only
+  copy_on_write, // private, a batch copies the pages it writes
+};
+
+// everything that decides where an entry sits in a block
+struct layout {
+  uint32_t B;
+  uint32_t fanout;
+  uint32_t entry_bytes;
+  uint32_t max_level;
+  uint32_t probe;        // 0 linear, 1 Robin Hood, 2 swiss
+  uint32_t block_header; // bytes in front of the records
+  uint32_t hash_bits;    // parlay::hash32 or hash64 of the key
+  bool operator==(const layout &o) const {
+    return memcmp(this, &o, sizeof(layout)) == 0;
+  }
+};
+
+struct header {
+  char magic[8];
+  uint32_t version;
+  layout l;
+  uint64_t tables;
+  uint64_t file_bytes;
+};
+static_assert(sizeof(header) <= page);
+
+// one per table. capacity 0: a table in small mode, its entries are in
+// small and there is no block
+struct table_record {
+  uint64_t offset; // of the block from the start of the file
+  uint32_t capacity;
+  uint32_t used_records;
+  uint32_t deleted_records;
+  uint32_t unused;
+  uint64_t roommate;
+  uint8_t small[64];
+};
+
+inline size_t round_up(size_t bytes, size_t to) {
+  return (bytes + to - 1) / to * to;
+}
+inline size_t records_bytes(uint64_t tables) {
+  return round_up(tables * sizeof(table_record), page);
+}
+inline void fail(const char *what, const char *path) {
+  std::cerr << what << " " << path << std::endl;
+  std::abort();
+}
+
+// write n tables: bytes(i) is the size of table i's block, 0 in small
+// mode, record(i, offset) its record for a block at offset and block(i)
+// the block itself
+template <class Bytes, class Record, class Block>
+void save(const char *path, const layout &l, uint64_t n, Bytes &&bytes,
+          Record &&record, Block &&block) {
+  FILE *f = fopen(path, "wb");
+  if (f == nullptr)
+    fail("cannot write snapshot", path);
+  // a page of zeros covers every gap in the file
+  static const char zeros[page] = {};
+  auto write = [&](const void *p, size_t len) {
+    if (len && fwrite(p, 1, len, f) != len)
+      fail("cannot write snapshot", path);
+  };
+  auto pad = [&](size_t len) {
+    for (; len > page; len -= page)
+      write(zeros, page);
+    write(zeros, len);
+  };
+  uint64_t offset = page + records_bytes(n);
+  header h;
+  memset(&h, 0, sizeof(h));
+  memcpy(h.magic, magic, sizeof(magic));
+  h.version = version;
+  h.l = l;
+  h.tables = n;
+  for (uint64_t i = 0; i < n; i++)
+    offset += round_up(bytes(i), 64);
+  h.file_bytes = offset;
+  write(&h, sizeof(h));
+  pad(page - sizeof(h));
+  offset = page + records_bytes(n);
+  for (uint64_t i = 0; i < n; i++) {
+    table_record r = record(i, bytes(i) ? offset : 0);
+    write(&r, sizeof(r));
+    offset += round_up(bytes(i), 64);
+  }
+  pad(records_bytes(n) - n * sizeof(table_record));
+  for (uint64_t i = 0; i < n; i++) {
+    size_t b = bytes(i);
+    write(block(i), b);
+    pad(round_up(b, 64) - b);
+  }
+  if (fclose(f) != 0)
+    fail("cannot write snapshot", path);
+}
+
+// the whole file mapped in, checked against the layout of the loader
+struct mapping {
+  char *base;
+  size_t bytes;
+  const header &get_header() const { return *(const header *)base; }
+  const table_record *records() const {
+    return (const table_record *)(base + page);
+  }
+};
+// block_bytes(capacity) is the size of a block of the loader's table type
+// and small_capacity the entries it keeps inline. Every record must hold
+// counts that fit its table and point at a whole block inside the file
+template <class Bytes>
+mapping map(const char *path, mode m, const layout &l, uint32_t small_capacity,
+            Bytes &&block_bytes) {
+  // writes to a private mapping never reach the file, so it is opened
+  // read-only either way
+  int fd = open(path, O_RDONLY);
+  if (fd < 0)
+    fail("cannot open snapshot", path);
+  struct stat st;
+  if (fstat(fd, &st) != 0 || (size_t)st.st_size < page)
+    fail("not a snapshot", path);
+  void *p = mmap(nullptr, st.st_size,
+                 m == mode::read_only ? PROT_READ : PROT_READ | PROT_WRITE,
+                 m == mode::read_only ? MAP_SHARED : MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (p == MAP_FAILED)
+    fail("cannot map snapshot", path);
+  mapping mp{(char *)p, (size_t)st.st_size};
+  const header &h = mp.get_header();
+  if (memcmp(h.magic, magic, sizeof(magic)) != 0 || h.version != version)
+    fail("not a snapshot of this version", path);
+  if (!(h.l == l))
+    fail("snapshot layout does not match the table type", path);
+  if (h.file_bytes != mp.bytes)
+    fail("truncated snapshot", path);
+  if (h.tables > mp.bytes / sizeof(table_record) ||
+      page + records_bytes(h.tables) > mp.bytes)
+    fail("corrupt snapshot records", path);
+  uint64_t blocks = page + records_bytes(h.tables);
+  for (uint64_t i = 0; i < h.tables; i++) {
+    const table_record &r = mp.records()[i];
+    if (r.capacity == 0) { // small mode, no block
+      if (r.used_records > small_capacity)
+        fail("corrupt snapshot records", path);
+      continue;
+    }
+    if (r.capacity % l.B != 0 || r.capacity < 2 * l.B ||
+        (uint64_t)r.used_records + r.deleted_records > r.capacity)
+      fail("corrupt snapshot records", path);
+    size_t b = block_bytes(r.capacity);
+    if (r.offset < blocks || r.offset % 64 != 0 || r.offset > mp.bytes ||
+        b > mp.bytes - r.offset)
+      fail("corrupt snapshot block", path);
+  }
+  return mp;
+}
+
+} // namespace nghs_snapshot
+#endif
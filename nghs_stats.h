@@ -0,0 +1,140 @@
+#ifndef NEIGHBOR_HASH_STATS
+#define NEIGHBOR_HASH_STATS
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+// What nghs_ht::stats() reports. The shape of the table (tombstones, probe
+// lengths) is read off the table when stats() runs. The counters (batches,
+// repaired nodes, phase timings, resizes) are only kept when compiled with
+// -DNGHS_STATS; without it they cost no space and no time and read as 0.
+#ifdef NGHS_STATS
+constexpr bool nghs_stats_enabled = true;
+#else
+constexpr bool nghs_stats_enabled = false;
+#endif
+
+// where a batch spends its time, fetch is timed per call
+enum class nghs_phase : uint8_t {
+  ensure_capacity, // sizing, rehashing and incremental moves
+  probe,           // the ops themselves
+  repair,          // Robin Hood shifts and the navigation tree
+  fetch,
+};
+constexpr uint32_t nghs_num_phases = 4;
+
+struct nghs_stats {
+  // live entries by probe length, how far each sits from its home slot:
+  // bucket 0 holds distance 0, bucket i distances in [2^(i-1), 2^i), the
+  // last bucket everything beyond
+  static constexpr uint32_t probe_buckets = 16;
+  uint64_t size = 0;     // entries, the roommate included
+  uint64_t capacity = 0; // slots, 0 in small mode
+  uint64_t tombstones = 0;
+  double tombstone_ratio = 0; // of the slots
+  uint64_t probe_histogram[probe_buckets] = {};
+  uint64_t max_probe = 0;
+  double mean_probe = 0;
+
+  // -DNGHS_STATS only, since construction or reset_stats()
+  uint64_t batches = 0;          // writer calls, batches and compactions
+  uint64_t repaired_nodes = 0;   // dirty navigation nodes rewritten
+  uint64_t last_batch_repaired = 0;
+  uint64_t phase_ns[nghs_num_phases] = {}; // indexed by nghs_phase
+  uint64_t resizes = 0;     // rehashes and incremental resizes started
+  uint64_t bytes_moved = 0; // entries copied into a new block
+  double repaired_per_batch() const {
+    return batches ? (double)repaired_nodes / batches : 0;
+  }
+  uint64_t time_ns(nghs_phase p) const { return phase_ns[(uint32_t)p]; }
+};
+
+// the counters a table keeps, nothing unless enabled
+template <bool Enabled> struct nghs_counters {
+  struct timer {};
+  timer time(nghs_phase) { return {}; }
+  void begin_batch() {}
+  void end_batch() {}
+  void count_repaired() {}
+  void count_resize(uint64_t) {}
+  void count_moved(uint64_t) {}
+  void fill_stats(nghs_stats &) const {}
+  void reset_stats() {}
+  void swap_counters(nghs_counters &) {}
+};
+template <> struct nghs_counters<true> {
+  std::atomic<uint64_t> batches{0}, repaired{0}, batch_start{0},
+      last_repaired{0}, resizes{0}, moved{0};
+  std::atomic<uint64_t> phase_ns[nghs_num_phases] = {};
+  // only the outermost writer phase is timed, a rehash inside
+  // ensure_capacity does not count as probing too
+  uint32_t depth = 0;
+
+  nghs_counters() = default;
+  nghs_counters(const nghs_counters &o) { copy(o); }
+  void copy(const nghs_counters &o) {
+    batches = o.batches.load();
+    repaired = o.repaired.load();
+    batch_start = o.batch_start.load();
+    last_repaired = o.last_repaired.load();
+    resizes = o.resizes.load();
+    moved = o.moved.load();
+    for (uint32_t p = 0; p < nghs_num_phases; p++)
+      phase_ns[p] = o.phase_ns[p].load();
+  }
+  void swap_counters(nghs_counters &o) {
+    nghs_counters t(o);
+    o.copy(*this);
+    copy(t);
+  }
+
+  class timer {
+    nghs_counters *c;
+    nghs_phase p;
+    bool timing;
+    std::chrono::steady_clock::time_point start;
+
+  public:
+    timer(nghs_counters *_c, nghs_phase _p) : c(_c), p(_p) {
+      // readers fetch while the writer runs, they keep out of depth
+      timing = p == nghs_phase::fetch || c->depth++ == 0;
+      if (timing)
+        start = std::chrono::steady_clock::now();
+    }
+    ~timer() {
+      if (timing)
+        c->phase_ns[(uint32_t)p] +=
+            std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now() - start)
+                .count();
+      if (p != nghs_phase::fetch)
+        c->depth--;
+    }
+    timer(const timer &) = delete;
+    timer &operator=(const timer &) = delete;
+  };
+  timer time(nghs_phase p) { return timer(this, p); }
+  void begin_batch() { batch_start = repaired.load(); }
+  void end_batch() {
+    batches++;
+    last_repaired = repaired - batch_start;
+  }
+  void count_repaired() { repaired.fetch_add(1, std::memory_order_relaxed); }
+  void count_resize(uint64_t bytes) {
+    resizes++;
+    moved += bytes;
+  }
+  void count_moved(uint64_t bytes) {
+    moved.fetch_add(bytes, std::memory_order_relaxed);
+  }
+  void fill_stats(nghs_stats &s) const {
+    s.batches = batches;
+    s.repaired_nodes = repaired;
+    s.last_batch_repaired = last_repaired;
+    for (uint32_t p = 0; p < nghs_num_phases; p++)
+      s.phase_ns[p] = phase_ns[p];
+    s.resizes = resizes;
+    s.bytes_moved = moved;
+  }
+  void reset_stats() { copy(nghs_counters()); }
+};
+#endif
@@ -1,14 +1,35 @@
 // g++ -O3 -Iparlaylib/include -std=c++17 ./unit_test.cpp -o unit_test
+#include "nghs_graph.h"
 #include "nghs_ht.h"
 #include "parlay/internal/get_time.h"
 #include "parlay/parallel.h"
 #include "parlay/primitives.h"
 #include "parlay/utilities.h"
+#include <algorithm>
+#include <atomic>
 #include <cassert>
 #include <cstdint>
+#include <cstdio>
 #include <string>
-template <uint32_t B = 16> void basic_test(uint32_t n) {
+#include <thread>
+#include <tuple>
+#include <type_traits>
+#include <vector>
+template <class Probe>
+constexpr bool robin_hood = std::is_same<Probe, robin_hood_probing>::value;
+template <class Probe> std::string probe_name() {
+  if (std::is_same<Probe, swiss_probing>::value)
+    return " swiss";
+  return robin_hood<Probe> ? " robin hood" : "";
+}
+template <class Tree> std::string fanout_name() {
+  return Tree::fanout > 2 ? " fanout " + std::to_string(Tree::fanout) : "";
+}
+template <uint32_t B = 16, class Probe = linear_probing,
+          class Tree = binary_tree>
+void basic_test(uint32_t n) {
   std::cout << "================================== start testing B = " << B
+            << probe_name<Probe>() << fanout_name<Tree>()
             << " =================================" << std::endl;
   // vertex id from 0,n-1
   // store u's nghs in a hashtable
@@ -17,7 +38,7 @@ template <uint32_t B = 16> void basic_test(uint32_t n) {
 
   // we will insert n-1 elements into hash table
   // set the capacity to 2 * n;
-  nghs_ht<B> A(2 * n);
+  nghs_ht<B, Probe, Tree> A(2 * n);
   std::cout << sizeof(A) << std::endl;
   // create pairs for vertex id [0,u-1] + [u+1,n-1]
   // there shouldn't be edges from u to u
@@ -41,6 +62,11 @@ template <uint32_t B = 16> void basic_test(uint32_t n) {
   parlay::parallel_for(0, res1.size(), [&](auto i) {
     assert(parlay::hash32((uint32_t)res1[i].first) % 31 + 2 == res1[i].second);
   });
+  auto hist = A.level_histogram();
+  for (uint32_t l = 2; l < 33; l++)
+    assert(hist[l] == parlay::count_if(vertices, [&](auto e) {
+             return e.second == l;
+           }));
   std::cout << "passed!" << std::endl;
 
   std::cout << "================= start batch fetch ===================="
@@ -60,9 +86,32 @@ template <uint32_t B = 16> void basic_test(uint32_t n) {
       }
       assert(parlay::hash32((uint32_t)result[j]) % 31 + 2 == i);
     });
+    assert(result.size() == std::min(n / 32, A.count(i)));
     std::cout << result.size() << std::endl;
   }
 
+  std::cout << "================= start ordered fetch =================="
+            << std::endl;
+  for (uint32_t i = 2; i < 33; i += 10) {
+    parlay::internal::timer t_fetch;
+    auto result = A.fetch_ordered(n / 64, i);
+    t_fetch.next("ordered fetch level " + std::to_string(i) + " edges");
+    // deterministic, and a smaller k gets a prefix of the larger answer
+    assert(result == A.fetch_ordered(n / 64, i));
+    auto half = A.fetch_ordered(n / 128, i);
+    assert(std::equal(half.begin(), half.end(), result.begin()));
+    auto all = A.fetch_ordered(n, i);
+    assert(all.size() == A.count(i));
+    assert(std::equal(result.begin(), result.end(), all.begin()));
+    auto sorted_all = parlay::sort(all);
+    assert(parlay::remove_duplicates_ordered(sorted_all, std::less<uint32_t>())
+               .size() == all.size());
+    parlay::parallel_for(0, all.size(), [&](auto j) {
+      assert(parlay::hash32((uint32_t)all[j]) % 31 + 2 == i);
+    });
+  }
+  std::cout << "passed!" << std::endl;
+
   std::cout << "================= start batch deletion ================="
             << std::endl;
   // delete [0,n-1]
@@ -93,6 +142,7 @@ template <uint32_t B = 16> void basic_test(uint32_t n) {
       }
       assert(parlay::hash32((uint32_t)result[j]) % 31 + 2 == i);
     });
+    assert(result.size() == std::min(n / 32, A.count(i)));
     std::cout << result.size() << std::endl;
   }
 
@@ -114,6 +164,7 @@ template <uint32_t B = 16> void basic_test(uint32_t n) {
     assert(res3[i].first > u);
     assert(2 == res3[i].second);
   });
+  assert(A.count(2) == res3.size());
   std::cout << "passed!" << std::endl;
 
   std::cout << "================= start batch find ====================="
@@ -124,10 +175,886 @@ template <uint32_t B = 16> void basic_test(uint32_t n) {
   auto res4 = A.batch_find(alive);
   t_find.next("batch find ");
   parlay::parallel_for(0, res4.size(), [&](auto i) { assert(res4[i] == 2); });
+  auto res5 = A.batch_find(alive, true);
+  t_find.next("batch find sorted by home slot");
+  assert(res5 == res4);
   std::cout << "passed!" << std::endl;
   std::cout << "total space used " << A.get_space_usage() / 1024 / 1024 << " MB"
             << std::endl;
 }
+template <uint32_t B = 16, class Probe = linear_probing,
+          class Tree = binary_tree>
+void graph_test(uint32_t n) {
+  std::cout << "================================== start graph test B = " << B
+            << probe_name<Probe>() << fanout_name<Tree>()
+            << " =================================" << std::endl;
+  // every table starts in small mode, vertex u gets u % 97 neighbors so
+  // most of them move to a hash table
+  nghs_graph<B, Probe, Tree> G(n);
+  std::cout << "initial space used " << G.get_space_usage() / 1024 << " KB"
+            << std::endl;
+  auto degree = [&](uint32_t u) { return u % 97; };
+  auto level = [&](uint32_t u, uint32_t v) {
+    return parlay::hash32(u * 31 + v) % 31 + 2;
+  };
+  // edge i of vertex u goes to u + i + 1, the batch is shuffled so the
+  // graph has to group it by vertex
+  auto offsets = parlay::scan(
+      parlay::tabulate(n, [&](uint32_t u) { return (size_t)degree(u); }));
+  auto edges = parlay::tabulate(offsets.second, [&](size_t j) {
+    uint32_t u = std::upper_bound(offsets.first.begin(),
+                                  offsets.first.end(), j) -
+                 offsets.first.begin() - 1;
+    uint32_t v = (u + (j - offsets.first[u]) + 1) % n;
+    return std::tuple(u, v, level(u, v));
+  });
+  edges = parlay::random_shuffle(edges);
+  parlay::internal::timer t_ins;
+  G.batch_insertion(edges);
+  t_ins.next("graph insertion of " + std::to_string(edges.size()) + " edges");
+  parlay::parallel_for(0, n, [&](auto u) {
+    auto res = G[u].to_sequence_sorted();
+    assert(res.size() == degree(u));
+    for (auto [v, l] : res)
+      assert(level(u, v) == l);
+  });
+  // the same edges bulk loaded
+  nghs_graph<B, Probe, Tree> H(n);
+  parlay::internal::timer t_build;
+  H.rebuild_from(edges);
+  t_build.next("graph bulk load");
+  parlay::parallel_for(0, n, [&](auto u) {
+    assert(H[u].to_sequence_sorted() == G[u].to_sequence_sorted());
+  });
+  std::cout << "passed!" << std::endl;
+
+  // move every edge to level 2, then drop the ones to even neighbors
+  auto updates = parlay::map(edges, [&](auto e) {
+    return std::tuple(std::get<0>(e), std::get<1>(e), (uint32_t)2);
+  });
+  parlay::internal::timer t_upd;
+  G.batch_update(updates);
+  t_upd.next("graph update");
+  auto deletions = parlay::map(
+      parlay::filter(edges, [&](auto e) { return std::get<1>(e) % 2 == 0; }),
+      [&](auto e) { return std::pair(std::get<0>(e), std::get<1>(e)); });
+  parlay::internal::timer t_del;
+  G.batch_deletion(deletions);
+  t_del.next("graph deletion");
+  parlay::parallel_for(0, n, [&](auto u) {
+    auto res = G[u].to_sequence_sorted();
+    for (auto [v, l] : res)
+      assert(v % 2 == 1 && l == 2);
+    assert(G[u].fetch(n, 2).size() == res.size());
+  });
+  std::cout << "passed!" << std::endl;
+  // one mixed batch: drop the level 2 edges of even vertices, give every
+  // vertex a level 3 self loop
+  auto mixed = parlay::map(
+      parlay::filter(edges, [&](auto e) { return std::get<1>(e) % 2 == 1; }),
+      [&](auto e) {
+        auto u = std::get<0>(e);
+        return std::tuple(u, std::get<1>(e), (uint32_t)2,
+                          u % 2 ? nghs_op::update : nghs_op::remove);
+      });
+  mixed.append(parlay::tabulate(n, [&](uint32_t u) {
+    return std::tuple(u, u, (uint32_t)3, nghs_op::upsert);
+  }));
+  G.batch_apply(mixed);
+  parlay::parallel_for(0, n, [&](auto u) {
+    assert(G[u].count(3) == 1 && (u % 2 == 1 || G[u].count(2) == 0));
+  });
+  // the counts sample() builds come from the arena and are counted there
+  auto before = G.get_space_usage();
+  G[95].sample(1, 2, 42);
+  assert(G[95].sample_bytes() > 0 && G.get_space_usage() >= before);
+  std::cout << "passed!" << std::endl;
+  std::cout << "total space used " << G.get_space_usage() / 1024 << " KB"
+            << std::endl;
+}
+template <uint32_t B = 16, class Probe = linear_probing>
+void compaction_test(uint32_t n) {
+  std::cout << "================================== start compaction test B = "
+            << B << probe_name<Probe>()
+            << " =================================" << std::endl;
+  auto level = [&](uint32_t v) { return parlay::hash32(v) % 31 + 2; };
+  nghs_ht<B, Probe> A;
+  // degree spikes to n and decays back, several times
+  for (int round = 0; round < 3; round++) {
+    auto ins = parlay::tabulate(n, [&](uint32_t v) {
+      return std::pair(v, level(v));
+    });
+    A.batch_insertion(ins);
+    auto peak = A.get_capacity();
+    // remove everything but every 64th neighbor, in two batches so that the
+    // first one leaves tombstones behind
+    auto del1 = parlay::filter(parlay::tabulate(n / 2, [&](uint32_t v) {
+                                 return v;
+                               }),
+                               [&](uint32_t v) { return v % 64 != 0; });
+    A.batch_deletion(del1);
+    assert(A.get_capacity() == peak);
+    auto del2 = parlay::filter(parlay::tabulate(n - n / 2, [&](uint32_t v) {
+                                 return v + n / 2;
+                               }),
+                               [&](uint32_t v) { return v % 64 != 0; });
+    A.batch_deletion(del2);
+    // decayed below the shrink threshold: table got smaller, no tombstones
+    assert(A.get_capacity() < peak);
+    assert(A.get_tombstones() == 0);
+    auto res = A.to_sequence_sorted();
+    assert(res.size() == (n + 63) / 64);
+    for (auto [v, l] : res)
+      assert(v % 64 == 0 && level(v) == l);
+    size_t fetched = 0;
+    for (uint32_t l = 2; l < 33; l++)
+      fetched += A.fetch(n, l).size();
+    assert(fetched == res.size());
+    // clear the rest for the next round
+    auto rest = parlay::map(res, [&](auto e) { return e.first; });
+    A.batch_deletion(rest);
+    assert(A.to_sequence_sorted().size() == 0);
+  }
+  // explicit compaction
+  auto ins = parlay::tabulate(n, [&](uint32_t v) {
+    return std::pair(v, level(v));
+  });
+  A.batch_insertion(ins);
+  auto del = parlay::tabulate(n / 8, [&](uint32_t v) { return v; });
+  A.batch_deletion(del);
+  // Robin Hood shifts clusters back instead of leaving tombstones
+  assert(robin_hood<Probe> == (A.get_tombstones() == 0));
+  A.compact();
+  assert(A.get_tombstones() == 0);
+  auto cap = A.get_capacity();
+  A.shrink_to_fit();
+  assert(A.get_capacity() <= cap);
+  auto res = A.to_sequence_sorted();
+  assert(res.size() == n - n / 8);
+  for (auto [v, l] : res)
+    assert(v >= n / 8 && level(v) == l);
+  std::cout << "passed!" << std::endl;
+}
+template <uint32_t B = 16, class Probe = linear_probing, class Entry>
+void packed_test(uint32_t n) {
+  using key_t = typename Entry::key_type;
+  std::cout << "================================== start packed test B = " << B
+            << probe_name<Probe>() << " key bits "
+            << 64 - __builtin_clzll(Entry::max_key) << " ===================="
+            << std::endl;
+  // spread the keys over the whole key range
+  key_t stride = Entry::max_key / n;
+  auto key = [&](uint32_t v) { return (key_t)v * stride + 1; };
+  auto level = [&](uint32_t v) {
+    return v == 0 ? 1 : parlay::hash32(v) % (Entry::max_level - 1) + 2;
+  };
+  nghs_ht<B, Probe, binary_tree, Entry> A;
+  auto ins = parlay::tabulate(n, [&](uint32_t v) {
+    return std::pair(key(v), (uint32_t)level(v));
+  });
+  A.batch_insertion(ins);
+  assert(A.get_size() == n);
+  auto keys = parlay::tabulate(n, [&](uint32_t v) { return key(v); });
+  auto found = A.batch_find(keys);
+  for (uint32_t v = 0; v < n; v++)
+    assert(found[v] == level(v));
+  size_t total = 0;
+  for (uint32_t l = 1; l <= Entry::max_level; l++) {
+    auto f = A.fetch(n, l);
+    assert(f.size() == A.count(l));
+    assert(parlay::sort(f) == parlay::sort(A.fetch_ordered(n, l)));
+    for (auto k : f)
+      assert(k % stride == 1 && level((k - 1) / stride) == l);
+    total += f.size();
+  }
+  assert(total == n);
+  // move every odd vertex to level 2, then delete the even ones
+  auto upd = parlay::tabulate(n / 2, [&](uint32_t i) {
+    return std::pair(key(2 * i + 1), (uint32_t)2);
+  });
+  A.batch_update(upd);
+  auto del = parlay::tabulate((n + 1) / 2, [&](uint32_t i) {
+    return key(2 * i);
+  });
+  A.batch_deletion(del);
+  assert(A.count(2) == n / 2);
+  found = A.batch_find(keys);
+  for (uint32_t v = 0; v < n; v++)
+    assert(found[v] == (v % 2 ? 2 : 0));
+  for (auto k : A.sample(n / 4, 2, 7))
+    assert(((k - 1) / stride) % 2 == 1);
+  std::cout << "passed!" << std::endl;
+  std::cout << "total space used " << A.get_space_usage() / 1024 << " KB"
+            << std::endl;
+}
+template <uint32_t B = 16, class Probe = linear_probing,
+          class Entry = unpacked_entry>
+void small_test() {
+  std::cout << "================================== start small mode test B = "
+            << B << probe_name<Probe>() << " ======================="
+            << std::endl;
+  using table_t = nghs_ht<B, Probe, binary_tree, Entry>;
+  table_t A;
+  uint32_t small = A.get_capacity(); // entries kept inline
+  auto level = [&](uint32_t v) { return v % 3 + 2; };
+  auto edges = [&](uint32_t lo, uint32_t hi) {
+    return parlay::tabulate(hi - lo, [&](uint32_t i) {
+      return std::pair(lo + i, (uint32_t)level(lo + i));
+    });
+  };
+  auto keys = [&](uint32_t lo, uint32_t hi) {
+    return parlay::tabulate(hi - lo, [&](uint32_t i) { return lo + i; });
+  };
+  // a level 1 edge, then fill the inline slots one edge at a time
+  auto r = parlay::sequence<std::pair<uint32_t, uint32_t>>(1, std::pair(0, 1));
+  A.batch_insertion(r);
+  for (uint32_t v = 1; v <= small; v++) {
+    auto e = edges(v, v + 1);
+    A.batch_insertion(e);
+  }
+  assert(A.get_space_usage() == sizeof(table_t));
+  assert(A.get_size() == small + 1 && A.count(1) == 1);
+  for (uint32_t l = 2; l < 5; l++) {
+    auto f = A.fetch(small, l);
+    assert(f.size() == A.count(l) && f == A.fetch_ordered(small, l));
+    for (auto v : f)
+      assert(level(v) == l);
+  }
+  auto q = keys(0, small + 2);
+  auto found = A.batch_find(q);
+  for (uint32_t v = 0; v < small + 2; v++)
+    assert(found[v] == (v == 0 ? 1 : v <= small ? level(v) : 0));
+  auto moved = A.fetch_and_set_level(small, 2, 5);
+  assert(A.count(2) == 0 && A.count(5) == moved.size());
+  // one more edge promotes the table
+  auto e = edges(small + 1, small + 2);
+  A.batch_insertion(e);
+  assert(A.get_capacity() > small && A.get_space_usage() > sizeof(table_t));
+  assert(A.get_size() == small + 2 && A.count(5) == moved.size());
+  // shrinking to just above half stays hashed, one less moves back inline
+  auto d = keys(1, small / 2 + 1);
+  A.batch_deletion(d);
+  assert(A.get_capacity() > small);
+  auto d2 = keys(small / 2 + 1, small / 2 + 3);
+  A.batch_deletion(d2);
+  assert(A.get_capacity() == small);
+  auto res = A.to_sequence_sorted();
+  assert(res.size() == A.get_size());
+  assert(res[0].first == 0 && res[0].second == 1);
+  auto rest = parlay::map(res, [](auto p) { return p.first; });
+  found = A.batch_find(rest);
+  for (size_t i = 1; i < res.size(); i++)
+    assert(res[i].first > small / 2 + 2 && found[i] == res[i].second);
+  assert(A.sample(small, 5, 1).size() == A.count(5));
+  // moving a table keeps its inline entries
+  table_t C(std::move(A));
+  assert(C.to_sequence_sorted() == res && A.get_size() == 0);
+  std::cout << "passed!" << std::endl;
+}
+template <uint32_t B = 16, class Probe = linear_probing>
+void resize_test(uint32_t n) {
+  std::cout << "================================== start resize test B = " << B
+            << probe_name<Probe>() << " =================================="
+            << std::endl;
+  // one block per batch keeps a resize running over many batches
+  nghs_ht<B, Probe, binary_tree, unpacked_entry, incremental_resize<1>> A;
+  uint32_t batch = 256;
+  std::vector<uint32_t> ref(n, 0); // expected level, 0 when absent
+  for (uint32_t r = 0; r * batch < n; r++) {
+    uint32_t lo = r * batch, hi = std::min(n, lo + batch);
+    auto ins = parlay::tabulate(hi - lo, [&](uint32_t i) {
+      return std::pair(lo + i, parlay::hash32(lo + i) % 31 + 2);
+    });
+    A.batch_insertion(ins);
+    for (auto [v, l] : ins)
+      ref[v] = l;
+    // move older edges that may still wait in the old table
+    auto upd = parlay::filter(
+        parlay::tabulate(batch, [&](uint32_t i) { return r / 2 * batch + i; }),
+        [&](uint32_t v) { return v % 8 != 0 && ref[v]; });
+    auto upd_l = parlay::map(upd, [&](uint32_t v) {
+      return std::pair(v, r % 31 + 2);
+    });
+    A.batch_update(upd_l);
+    for (auto v : upd)
+      ref[v] = r % 31 + 2;
+    if (r > 0) {
+      auto del = parlay::filter(
+          parlay::tabulate(batch,
+                           [&](uint32_t i) { return (r - 1) * batch + i; }),
+          [&](uint32_t v) { return v % 8 == 0; });
+      A.batch_deletion(del);
+      for (auto v : del)
+        ref[v] = 0;
+    }
+    for (uint32_t l = 2; l < 33; l += 3) {
+      auto f = A.fetch(n, l);
+      assert(f.size() == A.count(l));
+      for (auto v : f)
+        assert(ref[v] == l);
+    }
+    if (r % 16 == 0) {
+      auto keys = parlay::tabulate(hi, [](uint32_t v) { return v; });
+      auto found = A.batch_find(keys);
+      for (uint32_t v = 0; v < hi; v++)
+        assert(found[v] == ref[v]);
+    }
+  }
+  auto res = A.to_sequence_sorted();
+  assert(res.size() == A.get_size());
+  for (auto [v, l] : res)
+    assert(ref[v] == l);
+  // queries that need a single table finish the resize first
+  for (uint32_t l = 2; l < 33; l += 5) {
+    assert(A.fetch_ordered(n, l).size() == A.count(l));
+    assert(A.sample(n, l, l).size() == A.count(l));
+  }
+  std::cout << "passed!" << std::endl;
+}
+template <uint32_t B = 16, class Probe = linear_probing>
+void apply_test(uint32_t n, uint32_t keys) {
+  std::cout << "================================== start mixed batch test B = "
+            << B << probe_name<Probe>() << " keys " << keys
+            << " =======================" << std::endl;
+  nghs_ht<B, Probe> A;
+  std::vector<uint32_t> ref(keys, 0); // expected level, 0 when absent
+  // the roommate moves into the table while another edge takes its place
+  using op_t = std::tuple<uint32_t, uint32_t, nghs_op>;
+  auto first = parlay::sequence<op_t>(1, op_t(0, 1, nghs_op::insert));
+  A.batch_apply(first);
+  auto swap = parlay::sequence<op_t>{op_t(1, 1, nghs_op::upsert),
+                                     op_t(0, 5, nghs_op::upsert)};
+  A.batch_apply(swap);
+  assert(A.count(1) == 1 && A.fetch(1, 1)[0] == 1 && A.count(5) == 1);
+  ref[0] = 5;
+  ref[1] = 1;
+  // and the same in small mode, with the roommate ordered after its successor
+  nghs_ht<B, Probe> S;
+  auto small = parlay::sequence<op_t>{op_t(10, 1, nghs_op::insert),
+                                      op_t(20, 3, nghs_op::insert)};
+  S.batch_apply(small);
+  auto small_swap = parlay::sequence<op_t>{op_t(10, 4, nghs_op::upsert),
+                                           op_t(5, 1, nghs_op::upsert)};
+  S.batch_apply(small_swap);
+  auto small_keys = parlay::sequence<uint32_t>{5, 10, 20};
+  auto small_found = S.batch_find(small_keys);
+  assert(small_found[0] == 1 && small_found[1] == 4 && small_found[2] == 3);
+  assert(S.count(1) == 1 && S.get_size() == 3);
+  // every round draws n ops over few keys, so most keys see several
+  for (uint32_t r = 0; r < 8; r++) {
+    auto ops = parlay::tabulate(n, [&](uint32_t i) {
+      auto h = parlay::hash32(r * n + i);
+      uint32_t k = h % (keys - 2) + 2;
+      return op_t(k, (h >> 8) % 31 + 2, (nghs_op)((h >> 16) % 4));
+    });
+    A.batch_apply(ops);
+    for (auto [k, l, op] : ops) {
+      if (op == nghs_op::remove)
+        ref[k] = 0;
+      else if (op != nghs_op::update || ref[k])
+        ref[k] = l;
+    }
+    auto all = parlay::tabulate(keys, [](uint32_t k) { return k; });
+    auto found = A.batch_find(all);
+    for (uint32_t k = 0; k < keys; k++)
+      assert(found[k] == ref[k]);
+    size_t total = 0;
+    for (uint32_t l = 1; l < 33; l++) {
+      assert(A.fetch(keys, l).size() == A.count(l));
+      total += A.count(l);
+    }
+    assert(total == A.get_size());
+  }
+  std::cout << "passed!" << std::endl;
+}
+template <uint32_t B = 16, class Probe = linear_probing,
+          class Resize = blocking_resize>
+void concurrent_test(uint32_t n) {
+  std::cout << "================================== start concurrent test B = "
+            << B << probe_name<Probe>() << " =================================="
+            << std::endl;
+  nghs_ht<B, Probe, binary_tree, unpacked_entry, Resize, concurrent_readers> A;
+  // the reader only looks at the even keys, they stay at level 2 while the
+  // writer grows and shrinks the table with the odd ones
+  auto stable = parlay::tabulate(
+      n / 2, [](uint32_t i) { return std::pair(2 * i, (uint32_t)2); });
+  A.batch_insertion(stable);
+  auto keys = parlay::map(stable, [](auto e) { return e.first; });
+  std::atomic<bool> done(false);
+  std::thread reader([&] {
+    size_t rounds = 0;
+    while (!done.load() || rounds == 0) {
+      auto before = A.version();
+      auto found = A.batch_find(keys);
+      for (auto l : found)
+        assert(l == 2);
+      auto f = A.fetch(n, 2);
+      assert(f.size() == n / 2);
+      for (auto k : f)
+        assert(k % 2 == 0);
+      assert(A.version() >= before);
+      rounds++;
+    }
+  });
+  uint32_t chunk = n / 16;
+  for (uint32_t r = 0; r < 32; r++) {
+    if (r % 8 == 7) {
+      auto del =
+          parlay::tabulate(7 * chunk, [](uint32_t i) { return 2 * i + 1; });
+      A.batch_deletion(del);
+      continue;
+    }
+    auto ins = parlay::tabulate(chunk, [&](uint32_t i) {
+      uint32_t k = 2 * ((r % 8) * chunk + i) + 1;
+      return std::pair(k, r % 30 + 3);
+    });
+    A.batch_insertion(ins);
+  }
+  done = true;
+  reader.join();
+  // more short-lived readers than the epoch has slots, each exit frees one
+  auto one = parlay::sequence<uint32_t>(1, 0);
+  for (uint32_t t = 0; t < 2048; t++)
+    std::thread([&] { assert(A.batch_find(one)[0] == 2); }).join();
+  assert(A.version() % 2 == 0);
+  assert(A.get_size() == n / 2 && A.count(2) == n / 2);
+  std::cout << "passed!" << std::endl;
+}
+template <class Alloc> void alloc_test(uint32_t n) {
+  std::cout << "================================== start allocation test n = "
+            << n << " ==================================" << std::endl;
+  using table_t = nghs_ht<16, linear_probing, binary_tree, unpacked_entry,
+                          blocking_resize, exclusive_access, Alloc>;
+  // large enough for the block to take whole huge pages
+  table_t A(n);
+  auto ins = parlay::tabulate(
+      n, [](uint32_t i) { return std::pair(i, parlay::hash32(i) % 31 + 2); });
+  A.batch_insertion(ins);
+  auto keys = parlay::tabulate(n, [](uint32_t i) { return i; });
+  auto found = A.batch_find(keys);
+  for (uint32_t i = 0; i < n; i++)
+    assert(found[i] == ins[i].second);
+  // grows into a new block and shrinks back, both returned to Alloc
+  auto more = parlay::tabulate(
+      n, [&](uint32_t i) { return std::pair(n + i, (uint32_t)2); });
+  A.batch_insertion(more);
+  auto del = parlay::tabulate(n + n / 8 * 7, [](uint32_t i) { return i; });
+  A.batch_deletion(del);
+  assert(A.get_size() == n / 8 && A.count(2) == n / 8);
+  table_t C(std::move(A));
+  assert(C.fetch(n, 2).size() == n / 8);
+  std::cout << "passed!" << std::endl;
+}
+template <uint32_t B = 16, class Probe = linear_probing>
+void snapshot_test(uint32_t n) {
+  std::cout << "================================== start snapshot test B = "
+            << B << probe_name<Probe>() << " =================================="
+            << std::endl;
+  using table_t = nghs_ht<B, Probe>;
+  std::string path = "nghs_snapshot_test.bin";
+  table_t A(n);
+  auto ins = parlay::tabulate(
+      n, [](uint32_t i) { return std::pair(i, parlay::hash32(i) % 31 + 2); });
+  A.batch_insertion(ins);
+  auto del = parlay::tabulate(n / 4, [](uint32_t i) { return 4 * i; });
+  A.batch_deletion(del);
+  auto res = A.to_sequence_sorted();
+  A.save(path.c_str());
+  {
+    nghs_arena arena;
+    auto R =
+        table_t::load(path.c_str(), &arena, nghs_snapshot::mode::read_only);
+    assert(R.to_sequence_sorted() == res);
+    for (uint32_t l = 2; l < 33; l += 5)
+      assert(R.fetch(n, l).size() == A.count(l));
+  }
+  {
+    // a copy on write table grows out of the mapping, the file stays as is
+    nghs_arena arena;
+    auto W = table_t::load(path.c_str(), &arena);
+    auto more = parlay::tabulate(
+        2 * n, [&](uint32_t i) { return std::pair(n + i, (uint32_t)2); });
+    W.batch_insertion(more);
+    auto drop = parlay::map(more, [](auto e) { return e.first; });
+    W.batch_deletion(drop);
+    auto back = parlay::map(del, [](uint32_t v) {
+      return std::pair(v, parlay::hash32(v) % 31 + 2);
+    });
+    W.batch_insertion(back);
+    assert(W.to_sequence_sorted() == parlay::sort(ins));
+    auto again = table_t::load(path.c_str(), &arena);
+    assert(again.to_sequence_sorted() == res);
+  }
+  // a graph mixes tables in small mode with tables that have blocks
+  {
+    nghs_graph<B, Probe> G(n / 16);
+    auto edges = parlay::tabulate(n, [&](uint32_t i) {
+      uint32_t u = i % (n / 16), v = parlay::hash32(i) % n;
+      return std::tuple(u, v, (uint32_t)(v % 31 + 2));
+    });
+    edges = parlay::filter(edges, [&](auto e) {
+      return std::get<0>(e) % 8 != 0 || std::get<1>(e) % 64 == 0;
+    });
+    edges = parlay::remove_duplicates_ordered(edges, [](auto a, auto b) {
+      return std::pair(std::get<0>(a), std::get<1>(a)) <
+             std::pair(std::get<0>(b), std::get<1>(b));
+    });
+    G.batch_insertion(edges);
+    G.save(path.c_str());
+    nghs_graph<B, Probe> H(path.c_str(), nghs_snapshot::mode::copy_on_write);
+    assert(H.num_vertices() == G.num_vertices());
+    parlay::parallel_for(0, n / 16, [&](uint32_t u) {
+      assert(H[u].to_sequence_sorted() == G[u].to_sequence_sorted());
+    });
+    auto all = parlay::map(edges, [](auto e) {
+      return std::pair(std::get<0>(e), std::get<1>(e));
+    });
+    H.batch_deletion(all);
+    parlay::parallel_for(0, n / 16,
+                         [&](uint32_t u) { assert(H[u].get_size() == 0); });
+  }
+  std::remove(path.c_str());
+  std::cout << "passed!" << std::endl;
+}
+template <uint32_t B = 16, class Probe = linear_probing>
+void stats_test(uint32_t n) {
+  std::cout << "================================== start stats test B = " << B
+            << probe_name<Probe>() << " =================================="
+            << std::endl;
+  nghs_ht<B, Probe> A(n / 4);
+  auto ins = parlay::tabulate(
+      n, [](uint32_t i) { return std::pair(i, parlay::hash32(i) % 31 + 2); });
+  A.batch_insertion(ins); // grows once
+  auto del = parlay::tabulate(n / 8, [](uint32_t i) { return 8 * i; });
+  A.batch_deletion(del);
+  auto s = A.stats();
+  uint64_t live = 0;
+  for (auto c : s.probe_histogram)
+    live += c;
+  assert(s.size == n - n / 8 && live == s.size);
+  assert(s.capacity > 0 && s.mean_probe <= s.max_probe);
+  if (robin_hood<Probe>)
+    assert(s.tombstones == 0);
+  else
+    assert(s.tombstones == n / 8 &&
+           s.tombstone_ratio == (double)s.tombstones / s.capacity);
+  A.fetch(n, 2);
+  s = A.stats();
+  if constexpr (nghs_stats_enabled) {
+    assert(s.batches == 2 && s.resizes == 1 && s.repaired_nodes > 0);
+    assert(s.time_ns(nghs_phase::probe) > 0 &&
+           s.time_ns(nghs_phase::fetch) > 0);
+    A.reset_stats();
+    assert(A.stats().batches == 0);
+  } else
+    assert(s.batches == 0 && s.repaired_nodes == 0 && s.resizes == 0);
+  std::cout << "passed!" << std::endl;
+}
+template <uint32_t B = 16, class Probe = linear_probing,
+          class Resize = blocking_resize>
+void range_test(uint32_t n) {
+  std::cout << "================================== start range test B = " << B
+            << probe_name<Probe>() << " =================================="
+            << std::endl;
+  nghs_ht<B, Probe, binary_tree, unpacked_entry, Resize> A;
+  assert(A.min_level() == 0 && A.max_level() == 0 && !A.has_level(1));
+  // levels 5 to 20 skewed towards the low end, key 0 is the roommate
+  std::vector<uint32_t> ref(n, 0);
+  auto level = [&](uint32_t v, uint32_t r) {
+    return v == 0 ? 1 : 5 + __builtin_ctz(parlay::hash32(v + r) | 1 << 15);
+  };
+  auto check = [&]() {
+    std::vector<uint32_t> hist(33, 0);
+    for (auto l : ref)
+      hist[l]++;
+    uint32_t lo = 1, hi = 32;
+    while (lo < 33 && hist[lo] == 0)
+      lo++;
+    while (hi > 0 && hist[hi] == 0)
+      hi--;
+    assert(A.min_level() == (lo < 33 ? lo : 0));
+    assert(A.max_level() == hi);
+    for (uint32_t l = 1; l < 33; l++)
+      assert(A.has_level(l) == (hist[l] > 0));
+    using range = std::pair<uint32_t, uint32_t>;
+    for (auto [a, b] : {range(1, 32), range(1, 6), range(6, 9), range(12, 32),
+                        range(9, 6)}) {
+      uint32_t total = 0;
+      for (uint32_t l = a; l <= b; l++)
+        total += hist[l];
+      for (uint32_t k : {total, total / 2 + 1}) {
+        auto f = A.fetch_range(k, a, b);
+        assert(f.size() == std::min(k, total));
+        for (auto [v, l] : f)
+          assert(ref[v] == l && a <= l && l <= b);
+        auto keys = parlay::map(f, [](auto e) { return e.first; });
+        auto unique = parlay::remove_duplicates_ordered(keys, std::less<>());
+        assert(unique.size() == f.size());
+      }
+    }
+  };
+  // start in small mode, then grow one batch at a time and relevel a slice
+  uint32_t batch = 256;
+  for (uint32_t lo = 0; lo < n; lo = lo ? lo + batch : 2) {
+    uint32_t hi = lo ? std::min(n, lo + batch) : 2;
+    auto ins = parlay::tabulate(hi - lo, [&](uint32_t i) {
+      return std::pair(lo + i, (uint32_t)level(lo + i, 0));
+    });
+    A.batch_insertion(ins);
+    for (auto [v, l] : ins)
+      ref[v] = l;
+    auto upd = parlay::tabulate(lo / 2, [&](uint32_t i) {
+      return std::pair(i + 1, (uint32_t)level(i + 1, lo));
+    });
+    A.batch_update(upd);
+    for (auto [v, l] : upd)
+      ref[v] = l;
+    if (lo < 4 * batch || lo % (16 * batch) == 0)
+      check();
+  }
+  auto del = parlay::tabulate(n, [](uint32_t v) { return v; });
+  A.batch_deletion(del);
+  std::fill(ref.begin(), ref.end(), 0);
+  check();
+  std::cout << "passed!" << std::endl;
+}
+
+template <uint32_t B = 16, class Probe = linear_probing,
+          class Resize = blocking_resize, class Sync = exclusive_access>
+void bulk_test(uint32_t n) {
+  std::cout << "================================== start bulk build test B = "
+            << B << probe_name<Probe>() << " ======================="
+            << std::endl;
+  using table_t =
+      nghs_ht<B, Probe, binary_tree, unpacked_entry, Resize, Sync>;
+  // small sizes run many times, some clusters wrap past the last slot
+  for (uint32_t m : {0u, 3u, 40u, 100u, 1000u, n}) {
+    for (uint32_t seed = 0; seed < (m < n ? 16 : 1); seed++) {
+      auto ins = parlay::tabulate(m, [&](uint32_t i) {
+        uint32_t v = parlay::hash32(i + seed * n);
+        return std::pair(v, i == m / 2 ? 1 : v % 31 + 2);
+      });
+      ins = parlay::remove_duplicates_ordered(
+          ins, [](auto a, auto b) { return a.first < b.first; });
+      table_t A(ins), C(m);
+      C.batch_insertion(ins);
+      assert(A.get_size() == ins.size());
+      assert(A.to_sequence_sorted() == C.to_sequence_sorted());
+      auto keys = parlay::map(ins, [](auto e) { return e.first + 1; });
+      assert(A.batch_find(keys) == C.batch_find(keys));
+      for (uint32_t l = 1; l < 33; l++) {
+        assert(A.count(l) == C.count(l));
+        assert(A.fetch(m, l).size() == A.count(l));
+      }
+      // the table takes batches like any other
+      auto more = parlay::tabulate(m, [&](uint32_t i) {
+        return std::pair(parlay::hash32(i + seed * n) ^ 1, (uint32_t)5);
+      });
+      more = parlay::remove_duplicates_ordered(
+          more, [](auto a, auto b) { return a.first < b.first; });
+      auto more_keys = parlay::map(more, [](auto e) { return e.first; });
+      auto there = A.batch_find(more_keys);
+      more = parlay::pack(more, parlay::map(there, [](auto l) { return !l; }));
+      A.batch_insertion(more);
+      C.batch_insertion(more);
+      auto del = parlay::map(ins, [](auto e) { return e.first; });
+      A.batch_deletion(del);
+      C.batch_deletion(del);
+      assert(A.to_sequence_sorted() == C.to_sequence_sorted());
+      assert(A.fetch(m, 5).size() == A.count(5));
+      // and a rebuild throws the old edges away
+      A.rebuild_from(ins);
+      assert(A.get_size() == ins.size());
+      auto gone = parlay::map(more, [](auto e) { return e.first; });
+      assert(parlay::count_if(A.batch_find(gone), [](auto l) { return l; }) ==
+             0);
+      assert(A.batch_find(del) == parlay::map(ins, [](auto e) {
+               return e.second;
+             }));
+    }
+  }
+  std::cout << "passed!" << std::endl;
+}
+
+template <uint32_t B = 16, class Probe = linear_probing,
+          class Resize = blocking_resize>
+void lazy_test(uint32_t n) {
+  std::cout << "================================== start lazy repair test B = "
+            << B << probe_name<Probe>() << " ======================="
+            << std::endl;
+  nghs_ht<B, Probe, binary_tree, unpacked_entry, Resize> E;
+  nghs_ht<B, Probe, binary_tree, unpacked_entry, Resize, exclusive_access,
+          cache_aligned, lazy_repair>
+      L;
+  // rounds of four batches with no query in between, then every query
+  // that reads the tree has to see all four
+  uint32_t batch = n / 16;
+  std::vector<uint32_t> ref(n, 0);
+  for (uint32_t r = 0; r < 16; r++) {
+    auto ins = parlay::tabulate(batch, [&](uint32_t i) {
+      uint32_t v = r * batch + i;
+      return std::pair(v, parlay::hash32(v) % 31 + 2);
+    });
+    auto upd = parlay::tabulate(r * batch / 2, [&](uint32_t i) {
+      return std::pair(2 * i, (r + i) % 31 + 2);
+    });
+    upd = parlay::filter(upd, [&](auto e) { return ref[e.first] != 0; });
+    auto del = parlay::filter(
+        parlay::tabulate(r * batch, [](uint32_t v) { return v; }),
+        [&](uint32_t v) { return v % 5 == r % 5 && ref[v] != 0; });
+    auto ops = parlay::tabulate(batch / 4, [&](uint32_t i) {
+      return std::tuple(r * batch + 4 * i, (uint32_t)7, nghs_op::upsert);
+    });
+    auto run = [&](auto &A) {
+      A.batch_insertion(ins);
+      A.batch_update(upd);
+      A.batch_deletion(del);
+      A.batch_apply(ops);
+    };
+    run(E);
+    run(L);
+    for (auto [v, l] : ins)
+      ref[v] = l;
+    for (auto [v, l] : upd)
+      ref[v] = l;
+    for (auto v : del)
+      ref[v] = 0;
+    for (auto [v, l, op] : ops)
+      ref[v] = l;
+    if (r % 4 == 3)
+      L.flush();
+    assert(L.min_level() == E.min_level() && L.max_level() == E.max_level());
+    for (uint32_t l = 2; l < 33; l += 5) {
+      assert(L.count(l) == E.count(l));
+      auto f = L.fetch(n, l);
+      assert(f.size() == L.count(l));
+      for (auto v : f)
+        assert(ref[v] == l);
+      uint32_t hi = std::min(l + 2, 32u);
+      assert(L.fetch_range(n, l, hi).size() == E.fetch_range(n, l, hi).size());
+    }
+  }
+  assert(L.to_sequence_sorted() == E.to_sequence_sorted());
+  for (uint32_t l = 2; l < 33; l += 7)
+    assert(L.fetch_ordered(n, l) == E.fetch_ordered(n, l));
+  if constexpr (nghs_stats_enabled)
+    assert(L.stats().repaired_nodes < E.stats().repaired_nodes);
+  std::cout << "passed!" << std::endl;
+}
+
+template <uint32_t B = 16, class Tree = binary_tree>
+void sample_test(uint32_t n) {
+  std::cout << "================================== start sample test B = " << B
+            << fanout_name<Tree>() << " ================================="
+            << std::endl;
+  auto level = [&](uint32_t v) { return parlay::hash32(v) % 31 + 2; };
+  nghs_ht<B, linear_probing, Tree> A;
+  auto ins = parlay::tabulate(n, [&](uint32_t v) {
+    return std::pair(v, level(v));
+  });
+  A.batch_insertion(ins);
+  // the first sample builds the counts, as a batch readers can see
+  auto space = A.get_space_usage();
+  A.sample(1, 2, 1);
+  assert(A.sample_bytes() > 0);
+  assert(A.get_space_usage() == space + A.sample_bytes());
+  nghs_ht<B, linear_probing, Tree, unpacked_entry, blocking_resize,
+          concurrent_readers>
+      C;
+  C.batch_insertion(ins);
+  auto seq = C.version();
+  C.sample(1, 2, 1);
+  assert(C.version() == seq + 2);
+  C.sample(1, 2, 2);
+  assert(C.version() == seq + 2);
+  for (uint32_t l = 2; l < 33; l += 5) {
+    auto c = A.count(l);
+    auto k = c / 3;
+    auto with = A.sample(k, l, l, true);
+    assert(with.size() == k);
+    for (auto v : with)
+      assert(level(v) == l);
+    auto without = A.sample(k, l, l);
+    assert(without.size() == k);
+    assert(parlay::remove_duplicates_ordered(without, std::less<uint32_t>())
+               .size() == k);
+    for (auto v : without)
+      assert(level(v) == l);
+    assert(A.sample(c + 10, l, l).size() == c);
+  }
+  // every level 2 edge should come up about equally often
+  auto c = A.count(2);
+  size_t per_edge = 200;
+  auto draws = A.sample(c * per_edge, 2, 42, true);
+  auto sorted = parlay::sort(draws);
+  size_t run = 1, lo = draws.size(), hi = 0, distinct = 0;
+  for (size_t i = 1; i <= sorted.size(); i++) {
+    if (i == sorted.size() || sorted[i] != sorted[i - 1]) {
+      lo = std::min(lo, run);
+      hi = std::max(hi, run);
+      distinct++;
+      run = 1;
+    } else
+      run++;
+  }
+  std::cout << "level 2 edges " << c << " hits per edge in [" << lo << ", "
+            << hi << "]" << std::endl;
+  assert(distinct == c && lo > per_edge / 2 && hi < per_edge * 3 / 2);
+  // samples follow updates and deletions
+  auto upd = parlay::tabulate(n / 2, [&](uint32_t v) {
+    return std::pair(v, (uint32_t)2);
+  });
+  A.batch_update(upd);
+  auto del = parlay::tabulate(n / 4, [&](uint32_t v) { return v; });
+  A.batch_deletion(del);
+  auto after = A.sample(n, 2, 7);
+  assert(after.size() == A.count(2));
+  for (auto v : after)
+    assert(v >= n / 4 && (v < n / 2 || level(v) == 2));
+  std::cout << "passed!" << std::endl;
+}
+template <uint32_t B = 16, class Probe = linear_probing,
+          class Tree = binary_tree>
+void relevel_test(uint32_t n) {
+  std::cout << "================================== start relevel test B = " << B
+            << probe_name<Probe>() << fanout_name<Tree>()
+            << " =================================" << std::endl;
+  auto level = [&](uint32_t v) { return parlay::hash32(v) % 31 + 2; };
+  nghs_ht<B, Probe, Tree> A;
+  auto ins = parlay::tabulate(n, [&](uint32_t v) {
+    return std::pair(v, level(v));
+  });
+  A.batch_insertion(ins);
+  // push half of every level one level down, from the top, so an edge may
+  // drop several levels
+  parlay::internal::timer t;
+  for (uint32_t l = 32; l > 2; l--) {
+    auto before_l = A.count(l), before_down = A.count(l - 1);
+    auto moved = A.fetch_and_set_level(before_l / 2, l, l - 1);
+    assert(moved.size() == before_l / 2);
+    assert(A.count(l) == before_l - moved.size());
+    assert(A.count(l - 1) == before_down + moved.size());
+    auto found = A.batch_find(moved);
+    for (auto x : found)
+      assert(x == l - 1);
+  }
+  t.next("fetch and set level");
+  // level 1 takes one edge at most, and only while it is free
+  auto top = A.fetch_and_set_level(4, 2, 1);
+  assert(top.size() == 1 && A.count(1) == 1 && A.batch_find(top)[0] == 1);
+  assert(A.fetch_and_set_level(4, 2, 1).size() == 0);
+  auto back = A.fetch_and_set_level(4, 1, 2);
+  assert(back.size() == 1 && back[0] == top[0] && A.count(1) == 0);
+  assert(A.batch_find(top)[0] == 2);
+  // the navigation tree agrees with the counters
+  for (uint32_t l = 2; l < 33; l++)
+    assert(A.fetch(n, l).size() == A.count(l));
+  auto res = A.to_sequence_sorted();
+  assert(res.size() == n);
+  for (auto [v, l] : res)
+    assert(l >= 2 && l <= level(v));
+  std::cout << "passed!" << std::endl;
+}
 int main() {
   // basic_test(1024);
   basic_test(1024 * 1024);
@@ -139,5 +1066,68 @@ int main() {
   basic_test<64>(1024 * 1024);
   basic_test<64>(1024 * 1024 * 10);
   // basic_test(1024 * 1024 * 100);
+  basic_test<16, robin_hood_probing>(1024 * 1024);
+  basic_test<64, robin_hood_probing>(1024 * 1024 * 10);
+  basic_test<16, swiss_probing>(1024 * 1024);
+  basic_test<64, swiss_probing>(1024 * 1024);
+  basic_test<16, linear_probing, wide_tree>(1024 * 1024);
+  basic_test<64, robin_hood_probing, wide_tree>(1024 * 1024);
+  compaction_test(1024 * 1024);
+  compaction_test<64>(1024 * 1024);
+  compaction_test<16, robin_hood_probing>(1024 * 1024);
+  compaction_test<32, swiss_probing>(1024 * 1024);
+  relevel_test(1024 * 1024);
+  relevel_test<64, robin_hood_probing>(1024 * 1024);
+  relevel_test<16, linear_probing, wide_tree>(1024 * 1024);
+  packed_test<16, linear_probing, packed_entry<uint32_t>>(1024 * 1024);
+  packed_test<16, linear_probing, packed_entry<uint64_t>>(1024 * 1024);
+  packed_test<32, robin_hood_probing, packed_entry<uint64_t>>(1024 * 1024);
+  packed_test<16, swiss_probing, packed_entry<uint32_t, 4>>(1024 * 1024);
+  packed_test<16, linear_probing, unpacked_entry>(1024 * 1024);
+  small_test();
+  small_test<16, robin_hood_probing, packed_entry<uint32_t>>();
+  small_test<32, swiss_probing, packed_entry<uint64_t>>();
+  resize_test(1024 * 64);
+  resize_test<16, swiss_probing>(1024 * 64);
+  resize_test<32, robin_hood_probing>(1024 * 64);
+  apply_test(1024 * 64, 1024 * 16);
+  apply_test<16, robin_hood_probing>(1024 * 64, 1024 * 16);
+  apply_test<16, swiss_probing>(1024 * 64, 1024 * 16);
+  apply_test(16, 12);
+  concurrent_test(1024 * 64);
+  concurrent_test<16, swiss_probing>(1024 * 64);
+  concurrent_test<16, linear_probing, incremental_resize<1>>(1024 * 64);
+  alloc_test<cache_aligned>(1024 * 1024);
+  alloc_test<huge_pages<>>(1024 * 1024);
+  alloc_test<huge_pages<true>>(1024 * 1024);
+  alloc_test<numa_interleaved<>>(1024 * 1024);
+  snapshot_test(1024 * 64);
+  snapshot_test<32, robin_hood_probing>(1024 * 64);
+  snapshot_test<16, swiss_probing>(1024 * 64);
+  stats_test(1024 * 64);
+  stats_test<16, robin_hood_probing>(1024 * 64);
+
+  range_test<16>(1024 * 64);
+  range_test<32, robin_hood_probing>(1024 * 64);
+  range_test<16, swiss_probing, incremental_resize<1>>(1024 * 64);
+
+  bulk_test<16>(1024 * 64);
+  bulk_test<32, robin_hood_probing>(1024 * 64);
+  bulk_test<16, swiss_probing>(1024 * 64);
+  bulk_test<16, linear_probing, incremental_resize<1>, concurrent_readers>(
+      1024 * 64);
+
+  lazy_test<16>(1024 * 64);
+  lazy_test<32, robin_hood_probing>(1024 * 64);
+  lazy_test<16, swiss_probing, incremental_resize<1>>(1024 * 64);
+
+  sample_test(1024 * 64);
+  sample_test<64>(1024 * 64);
+  sample_test<16, wide_tree>(1024 * 64);
+  graph_test(1024 * 64);
+  graph_test<64>(1024 * 64);
+  graph_test<16, robin_hood_probing>(1024 * 64);
+  graph_test<16, swiss_probing>(1024 * 64);
+  graph_test<16, linear_probing, wide_tree>(1024 * 64);
   return 0;
 }
\ No newline at end of file